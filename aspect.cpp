@@ -25,30 +25,41 @@
 #include <stdlib.h>
 #include <math.h>
 #include "gdal_priv.h"
+#include "rowwindow.h"
+#include "membudget.h"
+#include "demoutput.h"
+#include "checkpoint.h"
+#include "demstats.h"
+#include "gradient.h"
 
 int main(int nArgc, char ** papszArgv) 
 { 
     GDALDataset *poDataset;     
     const float degrees_to_radians = 3.14159 / 180.0;
-    const float radians_to_degrees = 180.0 / 3.14159;           
     double      adfGeoTransform[6];
     float       *win;
     float       *aspectBuf;
-    float       *slopeBuf;
     float       dx;
     float       dy;
-    float       key;
-    float       slopePct;
     float       aspect;
     int         i;
     int         j;
-    int         n;
-    int         containsNull;
 
     /* -----------------------------------
      * Defaults
      */
     const char *pszFormat = "GTiff";
+    char      **papszOptions = NULL;
+    int         resume = 0;
+    Checkpoint  checkpoint;
+    int         yOff = 0;
+    int         nOutRows = -1;
+    const char *pszStatsFilename = NULL;
+    int         roseDirections = 8;
+    DemStats    stats;
+    char      **papszBands = NULL;
+    std::vector<int> bands;
+    MemBudget budget;
 
     /* -----------------------------------
      * Parse Input Arguments
@@ -58,7 +69,24 @@ int main(int nArgc, char ** papszArgv)
         printf( " \n Generates an aspect map from any GDAL-supported elevation raster\n"
                 " Outputs a 32-bit tiff with pixel values from 0-360 indicating azimuth\n"
                 " Usage: \n"
-                "   aspect input_dem output_aspect_map \n");
+                "   aspect input_dem output_aspect_map \n"
+                "                 [-of output format: GTiff or RAW] [-co NAME=VALUE]*\n"
+                "                 [-mem memory budget in MB] [-resume [-ci seconds]]\n"
+                "                 [-rows first count] [-stats report.json|csv [-rose directions (default=8)]]\n"
+                "                 [-b band]* [-b all]\n"
+                "   aspect gradient_raster output_aspect_map [options]\n"
+                " -co passes creation options to the driver, e.g. -co COMPRESS=DEFLATE\n"
+                " -resume checkpoints every 300 seconds (-ci seconds) and, rerun with the\n"
+                "   same arguments, carries on from the last checkpoint\n"
+                " -rows computes just that strip of the output, reading the rows\n"
+                "   around it from the input (used by demshard)\n"
+                " -stats writes min/max/mean/stddev and an aspect rose (flat cells\n"
+                "   excluded) to a report and the output's statistics, in the same pass\n"
+                " -b picks the input bands to process (default 1) in one pass, giving\n"
+                "   an output band and a section of the report for each\n"
+                " A gradient raster saved by hillshade -savegrad is read instead of a DEM\n"
+                "   without any window\n"
+                " An output of - streams raw Float32 rows to stdout\n");
         exit(1);
     }
 
@@ -67,53 +95,121 @@ int main(int nArgc, char ** papszArgv)
 
     for ( int iArg = 3; iArg < nArgc; iArg++ )
     {
-        // TO DO : Add Output Format, min slope for aspect
+        if( EQUAL(papszArgv[iArg],"-mem") )
+            budget.Set(papszArgv[iArg+1]);
+        if( EQUAL(papszArgv[iArg],"-of") )
+            pszFormat = papszArgv[iArg+1];
+        if( EQUAL(papszArgv[iArg],"-co") )
+            papszOptions = AddCreationOption(papszOptions, papszArgv[iArg+1]);
+        if( EQUAL(papszArgv[iArg],"-resume") )
+            resume = 1;
+        if( EQUAL(papszArgv[iArg],"-ci") )
+            checkpoint.SetInterval(atoi(papszArgv[iArg+1]));
+        if( EQUAL(papszArgv[iArg],"-rows") )
+        {
+            yOff = atoi(papszArgv[iArg+1]);
+            nOutRows = atoi(papszArgv[iArg+2]);
+        }
+        if( EQUAL(papszArgv[iArg],"-stats") )
+            pszStatsFilename = papszArgv[iArg+1];
+        if( EQUAL(papszArgv[iArg],"-rose") )
+            roseDirections = atoi(papszArgv[iArg+1]);
+        if( EQUAL(papszArgv[iArg],"-b") )
+            papszBands = CSLAddString(papszBands, papszArgv[iArg+1]);
+        // TO DO : min slope for aspect
     }
+    if (roseDirections < 1)
+        roseDirections = 8;
+    stats.SetRose(roseDirections);
 
 
+    papszOptions = ApplyCreationDefaults(papszOptions, pszFormat);
     GDALAllRegister(); 
 
     /*---------------------------------------
-     * Open Dataset and get raster band (assuming it is band #1)
+     * Open Dataset and get the raster bands (band #1 unless -b says otherwise)
      */
     poDataset = (GDALDataset *) GDALOpen( pszFilename, GA_ReadOnly );
     if( poDataset == NULL )
     {
-        printf( "Couldn't open dataset %s\n", 
-                pszFilename );
+        fprintf( stderr, "Couldn't open dataset %s\n", 
+                 pszFilename );
+        exit(1);
     }
+    // A gradient raster saved by hillshade -savegrad stands in for the DEM
+    float       gradScale;
+    const bool  isGradient = IsGradientRaster(poDataset, &gradScale);
+    if (isGradient ? !SelectGradientBands(poDataset, papszBands, bands)
+                   : !SelectBands(poDataset->GetRasterCount(), papszBands, bands))
+        exit(1);
+    const std::vector<int> readBands = isGradient ? GetGradientBands(poDataset, bands) : bands;
     GDALRasterBand  *poBand;       
-    poBand = poDataset->GetRasterBand( 1 );
+    poBand = poDataset->GetRasterBand( readBands[0] );
     poDataset->GetGeoTransform( adfGeoTransform );
+    const int   nBands = (int) bands.size();
+    const int   nReadBands = isGradient ? 2 * nBands : nBands;
 
     // Variables related to input dataset
     const double cellsizeY = adfGeoTransform[5];
     const double cellsizeX = adfGeoTransform[1];
-    const float nullValue = (float) poBand->GetNoDataValue( );
     const float aspectNullValue = -9999.;
     const int   nXSize = poBand->GetXSize();
     const int   nYSize = poBand->GetYSize();
+    if (nOutRows < 0)
+        nOutRows = nYSize - yOff;
+    if (yOff < 0 || nOutRows < 1 || yOff + nOutRows > nYSize)
+    {
+        fprintf( stderr, "Rows %d to %d are outside the input\n",
+                 yOff, yOff + nOutRows - 1 );
+        exit(1);
+    }
     aspectBuf    = (float *) CPLMalloc(sizeof(float)*nXSize); 
     win         = (float *) CPLMalloc(sizeof(float)*9);
+    const int   nChunkRows = budget.PickChunkRows(poBand, nReadBands);
+    const int   nQueueRows = budget.PickQueueRows(sizeof(double)*nXSize, OUTPUT_QUEUE_ROWS);
+    budget.Reserve(BandRowReader::GetMemorySize(nXSize, nReadBands, nChunkRows) +
+                   (isGradient ? 0 : nBands * RowWindow::GetMemorySize(nXSize, 1)) +
+                   AsyncOutputSink::GetMemorySize(nXSize, nQueueRows) +
+                   sizeof(float)*nXSize);
+    if (!budget.ApplyCacheMax())
+        exit(1);
+
+    // A window per band, all reading through one reader (a gradient
+    // raster's x and y bands are read through it too, without windows)
+    BandRowReader reader(poDataset, readBands, nChunkRows);
+    std::vector<RowWindow *> windows;
+    std::vector<DemStats>    bandStats(nBands, stats);
+    for (int b = 0; b < nBands && !isGradient; b++)
+        windows.push_back(new RowWindow(&reader, b, 1));
 
     /* -----------------------------------------
      * Open up the output datasets and copy over relevant metadata
      */
-    GDALDriver *poDriver;
-    poDriver = GetGDALDriverManager()->GetDriverByName(pszFormat);
-    GDALDataset      *poAspectDS;    
-    GDALRasterBand   *poAspectBand; 
-    char **papszOptions = NULL;
+    OutputSink       *poAspectOut;
 
     /*
-     * Open slope output map
+     * Open aspect output map
      */
-    poAspectDS = poDriver->Create(pszAspectFilename,nXSize,nYSize,1,GDT_Float32, 
-                                papszOptions );
-    poAspectDS->SetGeoTransform( adfGeoTransform );    
-    poAspectDS->SetProjection( poDataset->GetProjectionRef() );
-    poAspectBand = poAspectDS->GetRasterBand(1);
-    poAspectBand->SetNoDataValue(aspectNullValue);   
+    if (resume)
+        checkpoint.Enable(pszAspectFilename, pszFormat, pszFilename, nArgc, papszArgv);
+    if (pszStatsFilename != NULL)
+        checkpoint.SetStats(&bandStats);
+    int         iStartRow;
+    poAspectOut = checkpoint.Resume(nXSize, nOutRows, nQueueRows, &iStartRow);
+    if (poAspectOut == NULL)
+        poAspectOut = CreateOutputSink(pszAspectFilename, pszFormat, nXSize, nOutRows, nBands,
+                                       GDT_Float32, papszOptions, nQueueRows );
+    if (poAspectOut == NULL)
+    {
+        fprintf( stderr, "Couldn't create output %s\n", pszAspectFilename );
+        exit(1);
+    }
+    OffsetGeoTransform( adfGeoTransform, 0, yOff );
+    poAspectOut->SetGeoTransform( adfGeoTransform );    
+    poAspectOut->SetProjection( poDataset->GetProjectionRef() );
+    poAspectOut->SetNoDataValue(aspectNullValue);   
+    if (isGradient)
+        CheckGradientWindow( poDataset, poAspectOut );
 
 
     /* ------------------------------------------
@@ -125,50 +221,53 @@ int main(int nArgc, char ** papszArgv)
      *                 6 7 8
      *  and calculate slope and aspect
      */
-    for ( i = 0; i < nYSize; i++) 
+    for ( i = yOff + iStartRow; i < yOff + nOutRows; i++) 
     {
-        for ( j = 0; j < nXSize; j++) 
-        {
-            containsNull = 0;
-
-            // Exclude the edges 
-            if (i == 0 || j == 0 || i == nYSize-1 || j == nXSize-1 ) 
-            {
-                // We are at the edge so write nullValues and move on
-                aspectBuf[j] = nullValue;
-                continue;
-            }
+      for ( int b = 0; b < nBands; b++ )
+      {
+        RowWindow  *poWindow = isGradient ? NULL : windows[b];
+        const float *gradX = NULL;
+        const float *gradY = NULL;
 
-            // Read in 3x3 window
-            poBand->RasterIO( GF_Read, j-1, i-1, 3, 3,
-                          win, 3, 3, GDT_Float32, 
-                          0, 0 ); 
-
-            // Check if window has null value
-            for ( n = 0; n <= 8; n++) 
-            {
-               if(win[n] == nullValue) 
-               {
-                   containsNull = 1;
-                   break;
-               }
-            }
+        if (isGradient)
+        {
+            gradX = reader.GetRow(2 * b, i);
+            gradY = reader.GetRow(2 * b + 1, i);
+        }
+        else
+            poWindow->Advance(i);
 
-            if (containsNull == 1) 
+        for ( j = 0; j < nXSize; j++) 
+        {
+            // Skip the edges and windows containing nodata
+            if (isGradient ? (gradX[j] == GRADIENT_NODATA || gradY[j] == GRADIENT_NODATA)
+                           : !poWindow->IsValid(j)) 
             {
-                // We have nulls so write nullValues and move on
-                 aspectBuf[j] = nullValue;
+                // Write nullValues and move on
+                aspectBuf[j] = aspectNullValue;
                 continue;
             } 
             else 
             {
-                // We have a valid 3x3 window to compute aspect
+                if (isGradient)
+                {
+                    // The differences below, in proportion, from the saved
+                    // gradient (the rise per unit toward the west and north)
+                    dx = -DecodeGradient(gradX[j]) * cellsizeX;
+                    dy = DecodeGradient(gradY[j]) * cellsizeY;
+                }
+                else
+                {
+                    poWindow->GetWindow(j, win);
 
-                dx = ((win[2] + win[5] + win[5] + win[8]) -
-                      (win[0] + win[3] + win[3] + win[6]));
+                    // We have a valid 3x3 window to compute aspect
 
-                dy = ((win[6] + win[7] + win[7] + win[8]) - 
-                      (win[0] + win[1] + win[1] + win[2]));
+                    dx = ((win[2] + win[5] + win[5] + win[8]) -
+                          (win[0] + win[3] + win[3] + win[6]));
+
+                    dy = ((win[6] + win[7] + win[7] + win[8]) - 
+                          (win[0] + win[1] + win[1] + win[2]));
+                }
 
                 aspect = atan2(dy/8.0,-1.0*dx/8.0) / degrees_to_radians;
 
@@ -194,6 +293,9 @@ int main(int nArgc, char ** papszArgv)
            
                 aspectBuf[j] = aspect;
 
+                if (pszStatsFilename != NULL && aspect != aspectNullValue)
+                    bandStats[b].Add(aspect);
+
             }
         }
 
@@ -201,11 +303,40 @@ int main(int nArgc, char ** papszArgv)
          * Write Line to File
          */
 
-         poAspectBand->RasterIO( GF_Write, 0, i, nXSize, 1, 
-                      aspectBuf, nXSize, 1, GDT_Float32, 0, 0 ); 
+         if (!poAspectOut->WriteRow( b + 1, i - yOff, aspectBuf, GDT_Float32 ))
+         {
+             fprintf( stderr, "Couldn't write %s\n", pszAspectFilename );
+             exit(1);
+         }
+         bandStats[b].AddRows(1);
+      }
+      checkpoint.RowDone( poAspectOut, i - yOff + 1 );
     }
 
-    delete poAspectDS;
+    if (pszStatsFilename != NULL)
+    {
+        for (int b = 0; b < nBands; b++)
+        {
+            if (bandStats[b].GetCount() > 0)
+                poAspectOut->SetStatistics( b + 1, bandStats[b].GetMin(), bandStats[b].GetMax(),
+                                   bandStats[b].GetMean(), bandStats[b].GetStdDev() );
+        }
+        if (!WriteStatsReport(pszStatsFilename, bandStats, bands))
+            fprintf( stderr, "Couldn't write %s\n", pszStatsFilename );
+    }
+
+    if (!poAspectOut->Flush())
+    {
+        fprintf( stderr, "Couldn't write %s\n", pszAspectFilename );
+        exit(1);
+    }
+    delete poAspectOut;
+    for (size_t b = 0; b < windows.size(); b++)
+        delete windows[b];
+    CSLDestroy(papszBands);
+    CSLDestroy(papszOptions);
+    checkpoint.Finish();
+    ReportPeakRSS(budget);
 
     return 0;
 }
@@ -0,0 +1,152 @@
+/****************************************************************************
+ * boxsums.h
+ * Author: agent
+ * License : 
+ Copyright 2026 agent
+ Licensed under the Apache License, Version 2.0 (the "License"); 
+ you may not use this file except in compliance with the License. 
+ You may obtain a copy of the License at 
+ 
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software 
+ distributed under the License is distributed on an "AS IS" BASIS, 
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+ See the License for the specific language governing permissions and 
+ limitations under the License.
+
+ * sum, sum of squares and count of the valid cells in a square box
+ * around each cell, for large radius neighbourhood statistics
+ *
+ * This is a summed-area table restricted to the rows in flight of a
+ * RowWindow: per-column sums over the window rows are updated by adding
+ * the row entering the window and subtracting the row leaving it, then
+ * prefix-summed along the row. Any box sum is then two lookups, so the
+ * cost per cell doesn't depend on the radius and memory stays at the
+ * 2 * radius + 1 rows held by the window.
+ ****************************************************************************/
+
+#ifndef BOXSUMS_H
+#define BOXSUMS_H
+
+#include "rowwindow.h"
+
+class BoxSums
+{
+public:
+    // offset is subtracted from every value before summing, to keep the
+    // sums of squares small (use something close to the band mean)
+    BoxSums(RowWindow *window, int nXSize, int radius, double offset);
+    ~BoxSums();
+
+    // Bytes allocated for a row width
+    static GIntBig GetMemorySize(int nXSize);
+
+    // Advance the underlying window to row iRow and update the sums
+    void Advance(int iRow);
+
+    // Sums over the box around column iCol of the current row, clipped to
+    // the raster, with offset already subtracted from the values
+    void GetBox(int iCol, double *sum, double *sumSq, int *count) const;
+
+    double GetOffset() const { return offset; }
+
+private:
+    void AddRow(int dRow, int sign);
+
+    RowWindow *window;
+    int        nXSize;
+    int        radius;
+    int        iCurRow;
+    double     offset;
+    double    *colSum;
+    double    *colSumSq;
+    int       *colCount;
+    double    *prefSum;
+    double    *prefSumSq;
+    int       *prefCount;
+};
+
+inline BoxSums::BoxSums(RowWindow *windowIn, int nXSizeIn, int radiusIn,
+                        double offsetIn)
+{
+    window    = windowIn;
+    nXSize    = nXSizeIn;
+    radius    = radiusIn;
+    offset    = offsetIn;
+    iCurRow   = -radius - 2;
+    colSum    = (double *) CPLCalloc(nXSize, sizeof(double));
+    colSumSq  = (double *) CPLCalloc(nXSize, sizeof(double));
+    colCount  = (int *) CPLCalloc(nXSize, sizeof(int));
+    prefSum   = (double *) CPLCalloc(nXSize + 1, sizeof(double));
+    prefSumSq = (double *) CPLCalloc(nXSize + 1, sizeof(double));
+    prefCount = (int *) CPLCalloc(nXSize + 1, sizeof(int));
+}
+
+inline BoxSums::~BoxSums()
+{
+    CPLFree(colSum);
+    CPLFree(colSumSq);
+    CPLFree(colCount);
+    CPLFree(prefSum);
+    CPLFree(prefSumSq);
+    CPLFree(prefCount);
+}
+
+inline GIntBig BoxSums::GetMemorySize(int nXSize)
+{
+    return (GIntBig) (nXSize + 1) * 2 * (2 * sizeof(double) + sizeof(int));
+}
+
+inline void BoxSums::AddRow(int dRow, int sign)
+{
+    const float   *row  = window->GetRow(dRow);
+    const GUInt32 *mask = window->GetMask(dRow);
+
+    for (int j = 0; j < nXSize; j++) {
+        if ((mask[j >> 5] >> (j & 31)) & 1)
+            continue;
+        const double v = row[j] - offset;
+        colSum[j]   += sign * v;
+        colSumSq[j] += sign * v * v;
+        colCount[j] += sign;
+    }
+}
+
+inline void BoxSums::Advance(int iRow)
+{
+    if (iRow == iCurRow + 1) {
+        // Drop the top row before the window recycles it
+        AddRow(-radius, -1);
+        window->Advance(iRow);
+        AddRow(radius, 1);
+    } else {
+        for (int j = 0; j < nXSize; j++) {
+            colSum[j] = colSumSq[j] = 0;
+            colCount[j] = 0;
+        }
+        window->Advance(iRow);
+        for (int k = -radius; k <= radius; k++)
+            AddRow(k, 1);
+    }
+    iCurRow = iRow;
+
+    for (int j = 0; j < nXSize; j++) {
+        prefSum[j+1]   = prefSum[j] + colSum[j];
+        prefSumSq[j+1] = prefSumSq[j] + colSumSq[j];
+        prefCount[j+1] = prefCount[j] + colCount[j];
+    }
+}
+
+inline void BoxSums::GetBox(int iCol, double *sum, double *sumSq,
+                            int *count) const
+{
+    const int first = (iCol - radius < 0) ? 0 : iCol - radius;
+    const int last  = (iCol + radius >= nXSize) ? nXSize - 1 : iCol + radius;
+
+    *sum   = prefSum[last+1] - prefSum[first];
+    *sumSq = prefSumSq[last+1] - prefSumSq[first];
+    *count = prefCount[last+1] - prefCount[first];
+}
+
+#endif /* BOXSUMS_H */
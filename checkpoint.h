@@ -0,0 +1,277 @@
+/****************************************************************************
+ * checkpoint.h
+ * Author: agent
+ * License :
+ Copyright 2026 agent
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ * checkpoints for resuming an interrupted run (-resume option)
+ *
+ * Every checkpoint interval the output is flushed and the number of rows
+ * completed is saved in a sidecar, output.ckpt, next to the output:
+ *
+ *   INPUT=input_dem
+ *   INPUT_SIZE=bytes
+ *   INPUT_MTIME=seconds
+ *   INPUT_2=other_input         more files the output depends on (the color
+ *   INPUT_2_SIZE=bytes          scale of color-relief), numbered from 2
+ *   INPUT_2_MTIME=seconds
+ *   PARAMS=the other command line arguments
+ *   ROWS_DONE=n
+ *   STATS_1=...                 -stats accumulated over those rows, by band
+ *
+ * A run with -resume that finds a sidecar matching its inputs and
+ * arguments reopens the output and starts at row n with the statistics
+ * restored, so they still cover the whole output; at most one interval
+ * of work is lost. The sidecar is removed once the output is complete.
+ * Raw streams can't be reopened, so they are never checkpointed.
+ ****************************************************************************/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "gdal_priv.h"
+#include "cpl_string.h"
+#include "demoutput.h"
+#include "demstats.h"
+
+// Default seconds between checkpoints
+#define CHECKPOINT_INTERVAL 300
+
+class Checkpoint
+{
+public:
+    Checkpoint() : enabled(false), interval(CHECKPOINT_INTERVAL), lastSave(0),
+                   papszInputs(NULL), nInputs(0), poStats(NULL) {}
+    ~Checkpoint() { CSLDestroy(papszInputs); }
+
+    // Checkpoint the output of this run; arguments -resume, -ci and -mem
+    // (and their values) don't take part in the parameter check
+    void Enable(const char *pszOutFilename, const char *pszFormat,
+                const char *pszInFilename, int nArgc, char **papszArgv);
+    bool IsEnabled() const { return enabled; }
+
+    // Another file the output depends on: a change to it (size or
+    // modification time) also makes the run start over
+    void AddInput(const char *pszFilename);
+
+    // Seconds between checkpoints (-ci option)
+    void SetInterval(int nSeconds) { interval = nSeconds; }
+
+    // Statistics accumulated along with the output, one per band: saved at
+    // each checkpoint and restored by Resume
+    void SetStats(std::vector<DemStats> *poBandStats) { poStats = poBandStats; }
+
+    // Reopen the output where the sidecar left off if it matches this run;
+    // *piStartRow is set to the first row to compute. Returns NULL (and 0)
+    // when the output has to be created from scratch.
+    OutputSink *Resume(int nXSize, int nYSize, int nQueueRows, int *piStartRow);
+
+    // Call after each complete row; every interval flushes the output and
+    // saves the sidecar
+    void RowDone(OutputSink *poOut, int nRowsDone);
+
+    // The output is complete and closed: drop the sidecar
+    void Finish();
+
+private:
+    int  GetRowsDone(int nYSize);
+    void Save(int nRowsDone);
+
+    bool        enabled;
+    int         interval;
+    time_t      lastSave;
+    std::string osFilename;
+    std::string osOutput;
+    char      **papszInputs;    // INPUT... keys of the sidecar
+    int         nInputs;
+    std::string osParams;
+    std::vector<DemStats> *poStats;
+};
+
+inline void Checkpoint::Enable(const char *pszOutFilename, const char *pszFormat,
+                               const char *pszInFilename, int nArgc, char **papszArgv)
+{
+    if (IsRawOutput(pszOutFilename, pszFormat)) {
+        fprintf(stderr, "Warning: -resume needs a GDAL output, not a raw stream; ignored\n");
+        return;
+    }
+
+    enabled     = true;
+    osOutput    = pszOutFilename;
+    osFilename  = osOutput + ".ckpt";
+    AddInput(pszInFilename);
+    if (!enabled)
+        return;
+
+    osParams = "";
+    for (int iArg = 2; iArg < nArgc; iArg++) {
+        if (EQUAL(papszArgv[iArg], "-resume"))
+            continue;
+        if (EQUAL(papszArgv[iArg], "-ci") || EQUAL(papszArgv[iArg], "-mem")) {
+            iArg++;
+            continue;
+        }
+        if (!osParams.empty())
+            osParams += " ";
+        osParams += papszArgv[iArg];
+    }
+}
+
+inline void Checkpoint::AddInput(const char *pszFilename)
+{
+    if (!enabled)
+        return;
+
+    // Without its size and time a changed input would go unnoticed
+    VSIStatBufL sStat;
+    if (VSIStatL(pszFilename, &sStat) != 0) {
+        fprintf(stderr, "Warning: -resume can't check %s for changes; ignored\n",
+                pszFilename);
+        enabled = false;
+        return;
+    }
+
+    const std::string osKey = (++nInputs == 1) ? "INPUT" : CPLSPrintf("INPUT_%d", nInputs);
+    papszInputs = CSLSetNameValue(papszInputs, osKey.c_str(), pszFilename);
+    papszInputs = CSLSetNameValue(papszInputs, (osKey + "_SIZE").c_str(),
+                                  CPLSPrintf("%.0f", (double) sStat.st_size));
+    papszInputs = CSLSetNameValue(papszInputs, (osKey + "_MTIME").c_str(),
+                                  CPLSPrintf("%.0f", (double) sStat.st_mtime));
+}
+
+inline OutputSink *Checkpoint::Resume(int nXSize, int nYSize, int nQueueRows,
+                                      int *piStartRow)
+{
+    *piStartRow = 0;
+
+    const int nRowsDone = GetRowsDone(nYSize);
+    if (nRowsDone == 0)
+        return NULL;
+
+    OutputSink *poOut = OpenOutputSink(osOutput.c_str(), nQueueRows);
+    if (poOut == NULL || poOut->GetXSize() != nXSize || poOut->GetYSize() != nYSize) {
+        fprintf(stderr, "Couldn't reopen %s, starting over\n", osOutput.c_str());
+        delete poOut;
+        return NULL;
+    }
+
+    fprintf(stderr, "Resuming at row %d of %d\n", nRowsDone, nYSize);
+    lastSave = time(NULL);
+    *piStartRow = nRowsDone;
+    return poOut;
+}
+
+inline int Checkpoint::GetRowsDone(int nYSize)
+{
+    VSIStatBufL sStat;
+
+    if (!enabled || VSIStatL(osFilename.c_str(), &sStat) != 0)
+        return 0;
+
+    char **papszCkpt = CSLLoad(osFilename.c_str());
+    const char *pszParms = CSLFetchNameValue(papszCkpt, "PARAMS");
+    const char *pszRows  = CSLFetchNameValue(papszCkpt, "ROWS_DONE");
+    bool bMatch = pszParms && pszRows && osParams == pszParms &&
+                  CSLFetchNameValue(papszCkpt, CPLSPrintf("INPUT_%d", nInputs + 1)) == NULL;
+    int nRowsDone = 0;
+
+    for (int k = 0; bMatch && papszInputs != NULL && papszInputs[k] != NULL; k++) {
+        char       *pszKey = NULL;
+        const char *pszValue = CPLParseNameValue(papszInputs[k], &pszKey);
+        const char *pszSaved = CSLFetchNameValue(papszCkpt, pszKey);
+        bMatch = pszSaved != NULL && strcmp(pszSaved, pszValue) == 0;
+        CPLFree(pszKey);
+    }
+    if (bMatch)
+        nRowsDone = atoi(pszRows);
+    else
+        fprintf(stderr, "Checkpoint %s doesn't match the input or arguments, starting over\n",
+                osFilename.c_str());
+
+    // Statistics of the rows done, all or nothing
+    if (nRowsDone > 0 && poStats != NULL) {
+        std::vector<DemStats> restored(*poStats);
+        for (size_t b = 0; b < restored.size() && nRowsDone > 0; b++) {
+            const char *pszState = CSLFetchNameValue(papszCkpt, CPLSPrintf("STATS_%d", (int) b + 1));
+            if (pszState == NULL || !restored[b].SetState(pszState)) {
+                fprintf(stderr, "Checkpoint %s has no statistics, starting over\n",
+                        osFilename.c_str());
+                nRowsDone = 0;
+            }
+        }
+        if (nRowsDone > 0)
+            *poStats = restored;
+    }
+    CSLDestroy(papszCkpt);
+
+    if (nRowsDone <= 0 || nRowsDone > nYSize)
+        return 0;
+    return nRowsDone;
+}
+
+inline void Checkpoint::RowDone(OutputSink *poOut, int nRowsDone)
+{
+    if (!enabled)
+        return;
+
+    const time_t now = time(NULL);
+    if (lastSave == 0)
+        lastSave = now;
+    if (now - lastSave < interval)
+        return;
+
+    // Only record rows that made it to disk
+    if (poOut->Flush())
+        Save(nRowsDone);
+    lastSave = now;
+}
+
+inline void Checkpoint::Save(int nRowsDone)
+{
+    char **papszCkpt = NULL;
+    for (int k = 0; papszInputs != NULL && papszInputs[k] != NULL; k++)
+        papszCkpt = CSLAddString(papszCkpt, papszInputs[k]);
+    papszCkpt = CSLSetNameValue(papszCkpt, "PARAMS", osParams.c_str());
+    papszCkpt = CSLSetNameValue(papszCkpt, "ROWS_DONE", CPLSPrintf("%d", nRowsDone));
+    for (size_t b = 0; poStats != NULL && b < poStats->size(); b++)
+        papszCkpt = CSLSetNameValue(papszCkpt, CPLSPrintf("STATS_%d", (int) b + 1),
+                                    (*poStats)[b].GetState().c_str());
+
+    // Write a new sidecar and rename it over the old one, so an
+    // interruption never leaves a partial one behind
+    const std::string osTemp = osFilename + ".tmp";
+    if (CSLSave(papszCkpt, osTemp.c_str()) > 0) {
+#ifdef _WIN32
+        VSIUnlink(osFilename.c_str());
+#endif
+        VSIRename(osTemp.c_str(), osFilename.c_str());
+    }
+    CSLDestroy(papszCkpt);
+}
+
+inline void Checkpoint::Finish()
+{
+    VSIStatBufL sStat;
+
+    if (enabled && VSIStatL(osFilename.c_str(), &sStat) == 0)
+        VSIUnlink(osFilename.c_str());
+}
+
+#endif /* CHECKPOINT_H */
@@ -0,0 +1,1000 @@
+/****************************************************************************
+ * checks.cpp
+ * Author: agent
+ * License :
+ Copyright 2026 agent
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ * unit checks of the helpers the tools share (make check)
+ *
+ * Every failed check is printed; the exit status is the number of
+ * failures. Report files are written to the current directory and
+ * removed again. The tool checks run the tools built next to this
+ * program on a small DEM.
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "gdal_priv.h"
+#include "cpl_string.h"
+#include "cpl_spawn.h"
+#include "rowwindow.h"
+#include "boxsums.h"
+#include "checkpoint.h"
+#include "colorscale.h"
+#include "shadows.h"
+#include "demoutput.h"
+#include "demstats.h"
+#include "gradient.h"
+
+static int         nChecks = 0;
+static int         nFailed = 0;
+static std::string osToolDir;
+
+static void Check(bool bOK, const char *pszWhat)
+{
+    nChecks++;
+    if (!bOK) {
+        printf("FAILED: %s\n", pszWhat);
+        nFailed++;
+    }
+}
+
+static bool Near(double a, double b)
+{
+    return fabs(a - b) <= 1e-9 * (1 + fabs(b));
+}
+
+// The histogram part of a CSV report
+static std::string GetHistogram(const DemStats &stats)
+{
+    const std::string os = stats.FormatReport(false, "");
+    return os.substr(os.find("class,from,to,count"));
+}
+
+static bool SameStats(const DemStats &a, const DemStats &b)
+{
+    return a.GetRows() == b.GetRows() && a.GetCount() == b.GetCount() &&
+           Near(a.GetMin(), b.GetMin()) && Near(a.GetMax(), b.GetMax()) &&
+           Near(a.GetMean(), b.GetMean()) && Near(a.GetStdDev(), b.GetStdDev()) &&
+           GetHistogram(a) == GetHistogram(b);
+}
+
+/* -----------------------------------------
+ * DemStats: Add, Merge, reports and checkpoint state
+ */
+static void CheckDemStats()
+{
+    const double adfValues[] = { 3.5, 0, 12, 7.25, 44, 1.5, 5, 30, 9.75, 18, 2, 61 };
+    const int    nValues = sizeof(adfValues) / sizeof(adfValues[0]);
+    DemStats     classes;
+    classes.SetClasses("0,5,10,30");
+
+    DemStats whole(classes);
+    DemStats first(classes);
+    DemStats second(classes);
+    double   sum = 0;
+    for (int k = 0; k < nValues; k++) {
+        whole.Add(adfValues[k]);
+        (k < 5 ? first : second).Add(adfValues[k]);
+        sum += adfValues[k];
+    }
+    whole.AddRows(3);
+    first.AddRows(1);
+    second.AddRows(2);
+
+    double sumSq = 0;
+    for (int k = 0; k < nValues; k++)
+        sumSq += (adfValues[k] - sum / nValues) * (adfValues[k] - sum / nValues);
+    Check(whole.GetCount() == nValues && whole.GetMin() == 0 && whole.GetMax() == 61,
+          "DemStats count, min and max");
+    Check(Near(whole.GetMean(), sum / nValues) &&
+          Near(whole.GetStdDev(), sqrt(sumSq / nValues)),
+          "DemStats mean and standard deviation");
+    Check(GetHistogram(whole) ==
+          "class,from,to,count\n0-5,0,5,4\n5-10,5,10,3\n10-30,10,30,2\n30+,30,,3\n",
+          "DemStats histogram classes");
+
+    DemStats merged(classes);
+    merged.Merge(first);
+    merged.Merge(second);
+    Check(SameStats(merged, whole), "DemStats Merge of two parts equals the whole");
+
+    DemStats rose;
+    rose.SetRose(8);
+    rose.Add(359);
+    rose.Add(23);
+    rose.Add(180);
+    Check(GetHistogram(rose).find("N,337.5,22.5,1\nNE,22.5,67.5,1\n") != std::string::npos &&
+          GetHistogram(rose).find("S,157.5,202.5,1\n") != std::string::npos,
+          "DemStats aspect rose sectors");
+
+    DemStats read;
+    Check(whole.WriteReport("checks_stats.csv") && read.ReadReport("checks_stats.csv") &&
+          SameStats(read, whole), "DemStats CSV report round trip");
+
+    std::vector<DemStats> bandStats;
+    std::vector<int>      bands;
+    bandStats.push_back(first);
+    bandStats.push_back(second);
+    bands.push_back(2);
+    bands.push_back(3);
+    std::vector<DemStats> readStats;
+    std::vector<int>      readBands;
+    Check(WriteStatsReport("checks_stats.csv", bandStats, bands) &&
+          ReadStatsReport("checks_stats.csv", readStats, readBands) &&
+          readStats.size() == 2 && readBands == bands &&
+          SameStats(readStats[0], first) && SameStats(readStats[1], second),
+          "DemStats multi-band report round trip");
+    VSIUnlink("checks_stats.csv");
+
+    DemStats resumed(classes);
+    Check(resumed.SetState(whole.GetState().c_str()) && SameStats(resumed, whole),
+          "DemStats checkpoint state round trip");
+    Check(!rose.SetState(whole.GetState().c_str()),
+          "DemStats state of other classes is refused");
+}
+
+/* -----------------------------------------
+ * Gradient encoding: within half a step of the angle, sign kept
+ */
+static void CheckGradientEncoding()
+{
+    const float afGradients[] = { 0.0f, 0.001f, -0.3f, 1.0f, -2.5f, 40.0f, 1e6f, -1e6f };
+    const double halfStep = (M_PI / 2) / GRADIENT_STEPS / 2;
+    bool bOK = true;
+
+    for (size_t k = 0; k < sizeof(afGradients) / sizeof(afGradients[0]); k++) {
+        const float g = afGradients[k];
+        const float v = EncodeGradient(g);
+        if (v < -GRADIENT_STEPS || v > GRADIENT_STEPS || v == GRADIENT_NODATA ||
+            fabs(atan(DecodeGradient(v)) - atan(g)) > halfStep * 1.01 ||
+            (g > 0) != (DecodeGradient(v) > 0))
+            bOK = false;
+    }
+    Check(EncodeGradient(0) == 0, "EncodeGradient of a flat cell is 0");
+    Check(bOK, "EncodeGradient/DecodeGradient round trip");
+}
+
+/* -----------------------------------------
+ * -b on a gradient raster: the DEM's band numbers, mapped through the
+ * bands it was saved from
+ */
+static void CheckGradientBands()
+{
+    GDALDriver  *poDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+    GDALDataset *poDS = (poDriver != NULL) ?
+        poDriver->Create("", 3, 2, 4, GDT_Int16, NULL) : NULL;
+    if (poDS == NULL) {
+        Check(false, "Gradient bands: create a MEM dataset");
+        return;
+    }
+
+    std::vector<int> bands;
+    char           **papszBands = NULL;
+    papszBands = CSLAddString(NULL, "2");
+    Check(SelectGradientBands(poDS, papszBands, bands) && bands.size() == 1 && bands[0] == 2 &&
+          GetGradientBands(poDS, bands)[0] == 3 && GetGradientBands(poDS, bands)[1] == 4,
+          "Gradient bands without GRADIENT_BANDS are 1 to n");
+    CSLDestroy(papszBands);
+
+    poDS->SetMetadataItem("GRADIENT_BANDS", "2,3");
+    Check(SelectGradientBands(poDS, NULL, bands) && bands.size() == 1 && bands[0] == 2,
+          "Gradient bands default to the first saved");
+
+    papszBands = CSLAddString(NULL, "3");
+    Check(SelectGradientBands(poDS, papszBands, bands) && bands.size() == 1 && bands[0] == 3 &&
+          GetGradientBands(poDS, bands)[0] == 3 && GetGradientBands(poDS, bands)[1] == 4,
+          "Gradient bands map -b through GRADIENT_BANDS");
+    CSLDestroy(papszBands);
+
+    papszBands = CSLAddString(NULL, "all");
+    Check(SelectGradientBands(poDS, papszBands, bands) && bands.size() == 2 &&
+          bands[0] == 2 && bands[1] == 3, "Gradient bands all");
+    CSLDestroy(papszBands);
+
+    papszBands = CSLAddString(NULL, "1");
+    Check(!SelectGradientBands(poDS, papszBands, bands),
+          "Gradient bands refuse a DEM band that wasn't saved");
+    CSLDestroy(papszBands);
+    GDALClose(poDS);
+}
+
+/* -----------------------------------------
+ * RowWindow validity against a cell by cell test, moving down row by
+ * row and jumping back up, with nodata on both sides of mask words
+ */
+static void CheckRowWindow()
+{
+    const int   nXSize = 70;
+    const int   nYSize = 11;
+    const float noData = -9999;
+    std::vector<float> values(nXSize * nYSize, 1.0f);
+    const int   anNoData[][2] = { { 0, 5 }, { 3, 31 }, { 3, 32 }, { 5, 63 }, { 8, 20 }, { 10, 69 } };
+
+    for (size_t k = 0; k < sizeof(anNoData) / sizeof(anNoData[0]); k++)
+        values[anNoData[k][0] * nXSize + anNoData[k][1]] = noData;
+
+    GDALDriver  *poDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+    GDALDataset *poDS = (poDriver != NULL) ?
+        poDriver->Create("", nXSize, nYSize, 1, GDT_Float32, NULL) : NULL;
+    if (poDS == NULL) {
+        Check(false, "RowWindow: create a MEM dataset");
+        return;
+    }
+    poDS->GetRasterBand(1)->SetNoDataValue(noData);
+    poDS->GetRasterBand(1)->RasterIO( GF_Write, 0, 0, nXSize, nYSize,
+                                      &values[0], nXSize, nYSize, GDT_Float32, 0, 0 );
+
+    const int anRows[] = { 0, 1, 2, 3, 4, 5, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    for (int radius = 1; radius <= 4; radius++) {
+        std::vector<int> bands(1, 1);
+        BandRowReader reader(poDS, bands);
+        RowWindow     window(&reader, 0, radius);
+        bool          bOK = true;
+
+        for (size_t r = 0; r < sizeof(anRows) / sizeof(anRows[0]); r++) {
+            const int i = anRows[r];
+            window.Advance(i);
+            for (int j = 0; j < nXSize; j++) {
+                bool valid = true;
+                for (int y = i - radius; y <= i + radius; y++)
+                    for (int x = j - radius; x <= j + radius; x++)
+                        if (y < 0 || y >= nYSize || x < 0 || x >= nXSize ||
+                            values[y * nXSize + x] == noData)
+                            valid = false;
+                if (window.IsValid(j) != valid)
+                    bOK = false;
+            }
+        }
+        Check(bOK, CPLSPrintf("RowWindow validity of radius %d", radius));
+    }
+    GDALClose(poDS);
+}
+
+/* -----------------------------------------
+ * RowWindow masks: NaN is nodata whatever the band declares, and the
+ * raster's edges are never valid
+ */
+static GDALDataset *CreateMemDEM(const std::vector<float> &values, int nXSize, int nYSize,
+                                 bool hasNoData, float noData)
+{
+    GDALDriver  *poDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+    GDALDataset *poDS = (poDriver != NULL) ?
+        poDriver->Create("", nXSize, nYSize, 1, GDT_Float32, NULL) : NULL;
+    if (poDS == NULL)
+        return NULL;
+    if (hasNoData)
+        poDS->GetRasterBand(1)->SetNoDataValue(noData);
+    poDS->GetRasterBand(1)->RasterIO( GF_Write, 0, 0, nXSize, nYSize,
+                                      (void *) &values[0], nXSize, nYSize,
+                                      GDT_Float32, 0, 0 );
+    return poDS;
+}
+
+// Bits of the row mask of row iRow, one character per column
+static std::string GetMaskBits(GDALDataset *poDS, int iRow, int winDist)
+{
+    std::vector<int> bands(1, 1);
+    BandRowReader    reader(poDS, bands);
+    RowWindow        window(&reader, 0, winDist);
+    std::string      os;
+
+    window.Advance(iRow);
+    for (int j = 0; j < poDS->GetRasterXSize(); j++)
+        os += (window.GetMask(0)[j >> 5] & (1u << (j & 31))) ? '1' : '0';
+    return os;
+}
+
+static void CheckNoDataMasks()
+{
+    const float nan = (float) NAN;
+    const float afRow[] = { 1, nan, -9999, 4, 5 };
+    const std::vector<float> row(afRow, afRow + 5);
+
+    GDALDataset *poDS = CreateMemDEM(row, 5, 1, false, 0);
+    Check(poDS != NULL && GetMaskBits(poDS, 0, 0) == "01000",
+          "RowWindow: NaN is nodata in a band without nodata");
+    GDALClose(poDS);
+
+    poDS = CreateMemDEM(row, 5, 1, true, -9999);
+    Check(poDS != NULL && GetMaskBits(poDS, 0, 0) == "01100",
+          "RowWindow: NaN is nodata besides the band's nodata value");
+    GDALClose(poDS);
+
+    poDS = CreateMemDEM(row, 5, 1, true, nan);
+    Check(poDS != NULL && GetMaskBits(poDS, 0, 0) == "01000",
+          "RowWindow: NaN nodata value");
+    GDALClose(poDS);
+
+    // Edges: the first and last winDist rows and columns, everything when
+    // the raster is narrower than the window
+    const std::vector<float> flat(6 * 4, 1.0f);
+    poDS = CreateMemDEM(flat, 6, 4, false, 0);
+    if (poDS == NULL) {
+        Check(false, "RowWindow: create a MEM dataset");
+        return;
+    }
+    std::vector<int> bands(1, 1);
+    std::string      os;
+    for (int winDist = 1; winDist <= 3; winDist++) {
+        BandRowReader reader(poDS, bands);
+        RowWindow     window(&reader, 0, winDist);
+        for (int i = 0; i < 4; i++) {
+            window.Advance(i);
+            for (int j = 0; j < 6; j++)
+                os += window.IsValid(j) ? '1' : '0';
+            os += (i < 3) ? "," : "\n";
+        }
+    }
+    Check(os == "000000,011110,011110,000000\n"
+                "000000,000000,000000,000000\n"
+                "000000,000000,000000,000000\n",
+          "RowWindow: edges are never valid");
+    GDALClose(poDS);
+}
+
+/* -----------------------------------------
+ * BoxSums against sums taken cell by cell, with nodata and edges
+ */
+static void CheckBoxSums()
+{
+    const int    nXSize = 9;
+    const int    nYSize = 7;
+    const float  noData = -9999;
+    const double offset = 100;
+    std::vector<float> values(nXSize * nYSize);
+
+    for (int i = 0; i < nYSize; i++)
+        for (int j = 0; j < nXSize; j++)
+            values[i * nXSize + j] = (float) (100 + 3 * i - 2 * j + ((i * j) % 5));
+    values[2 * nXSize + 4] = noData;
+    values[6 * nXSize + 0] = noData;
+
+    GDALDriver  *poDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+    GDALDataset *poDS = (poDriver != NULL) ?
+        poDriver->Create("", nXSize, nYSize, 1, GDT_Float32, NULL) : NULL;
+    if (poDS == NULL) {
+        Check(false, "BoxSums: create a MEM dataset");
+        return;
+    }
+    poDS->GetRasterBand(1)->SetNoDataValue(noData);
+    poDS->GetRasterBand(1)->RasterIO( GF_Write, 0, 0, nXSize, nYSize,
+                                      &values[0], nXSize, nYSize, GDT_Float32, 0, 0 );
+
+    for (int radius = 1; radius <= 3; radius++) {
+        std::vector<int> bands(1, 1);
+        BandRowReader reader(poDS, bands, 4);
+        RowWindow     window(&reader, 0, radius);
+        BoxSums       box(&window, nXSize, radius, offset);
+        bool          bOK = true;
+
+        for (int i = 0; i < nYSize; i++) {
+            box.Advance(i);
+            for (int j = 0; j < nXSize; j++) {
+                double sum = 0, sumSq = 0;
+                int    count = 0;
+                for (int y = i - radius; y <= i + radius; y++) {
+                    for (int x = j - radius; x <= j + radius; x++) {
+                        if (y < 0 || y >= nYSize || x < 0 || x >= nXSize ||
+                            values[y * nXSize + x] == noData)
+                            continue;
+                        const double v = values[y * nXSize + x] - offset;
+                        sum += v;
+                        sumSq += v * v;
+                        count++;
+                    }
+                }
+
+                double boxSum, boxSumSq;
+                int    boxCount;
+                box.GetBox(j, &boxSum, &boxSumSq, &boxCount);
+                if (boxCount != count || !Near(boxSum, sum) || !Near(boxSumSq, sumSq))
+                    bOK = false;
+            }
+        }
+        Check(bOK, CPLSPrintf("BoxSums of radius %d", radius));
+    }
+    GDALClose(poDS);
+}
+
+/* -----------------------------------------
+ * Creation options: later -co replace earlier, defaults for GTiff only
+ */
+static void CheckCreationOptions()
+{
+    char **papszOptions = NULL;
+    papszOptions = AddCreationOption(papszOptions, "COMPRESS=LZW");
+    papszOptions = AddCreationOption(papszOptions, "TILED=YES");
+    papszOptions = AddCreationOption(papszOptions, "COMPRESS=DEFLATE");
+    Check(CSLCount(papszOptions) == 2 &&
+          EQUAL(CSLFetchNameValue(papszOptions, "COMPRESS"), "DEFLATE"),
+          "AddCreationOption replaces a repeated option");
+
+    char **papszHFA = ApplyCreationDefaults(CSLDuplicate(papszOptions), "HFA");
+    Check(CSLFetchNameValue(papszHFA, "NUM_THREADS") == NULL,
+          "ApplyCreationDefaults leaves other formats alone");
+    CSLDestroy(papszHFA);
+
+    papszOptions = ApplyCreationDefaults(papszOptions, "GTiff");
+    Check(CSLFetchNameValue(papszOptions, "NUM_THREADS") != NULL &&
+          EQUAL(CSLFetchNameValue(papszOptions, "NUM_THREADS"), "ALL_CPUS"),
+          "ApplyCreationDefaults threads GTiff compression");
+    CSLDestroy(papszOptions);
+
+    papszOptions = AddCreationOption(NULL, "COMPRESS=DEFLATE");
+    papszOptions = AddCreationOption(papszOptions, "NUM_THREADS=2");
+    papszOptions = ApplyCreationDefaults(papszOptions, "GTiff");
+    Check(EQUAL(CSLFetchNameValue(papszOptions, "NUM_THREADS"), "2"),
+          "ApplyCreationDefaults keeps a given NUM_THREADS");
+    CSLDestroy(papszOptions);
+
+    papszOptions = ApplyCreationDefaults(AddCreationOption(NULL, "TILED=YES"), "GTiff");
+    Check(CSLFetchNameValue(papszOptions, "NUM_THREADS") == NULL,
+          "ApplyCreationDefaults without compression");
+    CSLDestroy(papszOptions);
+}
+
+/* -----------------------------------------
+ * -b band selection
+ */
+static void CheckSelectBands()
+{
+    std::vector<int> bands;
+    char           **papszBands = NULL;
+
+    Check(SelectBands(3, NULL, bands) && bands.size() == 1 && bands[0] == 1,
+          "SelectBands defaults to band 1");
+
+    papszBands = CSLAddString(papszBands, "all");
+    Check(SelectBands(3, papszBands, bands) && bands.size() == 3 && bands[2] == 3,
+          "SelectBands all");
+    CSLDestroy(papszBands);
+
+    papszBands = CSLAddString(NULL, "3");
+    papszBands = CSLAddString(papszBands, "2");
+    Check(SelectBands(3, papszBands, bands) && bands.size() == 2 &&
+          bands[0] == 3 && bands[1] == 2, "SelectBands keeps the order given");
+    CSLDestroy(papszBands);
+
+    papszBands = CSLAddString(NULL, "4");
+    Check(!SelectBands(3, papszBands, bands), "SelectBands refuses a missing band");
+    CSLDestroy(papszBands);
+}
+
+/* -----------------------------------------
+ * ShadowSweep against a walk toward the sun from every cell, with the
+ * sun due north and due east (where the sweep needs no interpolation),
+ * over several blocks visited out of order
+ */
+static void CheckShadowSweep()
+{
+    const int    nXSize = 40;
+    const int    nYSize = 600;
+    const double cellSize = 10;
+    const float  z = 1.5f;
+    const float  alt = 30;
+    const float  noData = -9999;
+    std::vector<float> values(nXSize * nYSize);
+
+    srand(7);
+    for (int i = 0; i < nYSize; i++)
+        for (int j = 0; j < nXSize; j++)
+            values[i * nXSize + j] = (float) (100 + 60 * sin(i / 9.0) * cos(j / 7.0) +
+                                              (rand() % 1000) / 50.0);
+    for (int k = 0; k < 200; k++)
+        values[rand() % (nXSize * nYSize)] = noData;
+
+    GDALDataset *poDS = CreateMemDEM(values, nXSize, nYSize, true, noData);
+    if (poDS == NULL) {
+        Check(false, "ShadowSweep: create a MEM dataset");
+        return;
+    }
+
+    double zMin = 1e30, zMax = -1e30;
+    for (size_t k = 0; k < values.size(); k++) {
+        if (values[k] == noData)
+            continue;
+        zMin = (values[k] < zMin) ? values[k] : zMin;
+        zMax = (values[k] > zMax) ? values[k] : zMax;
+    }
+    const double drop = cellSize * tan(alt * 3.14159 / 180.0);
+
+    const float afAzimuths[] = { 0, 90 };
+    for (int a = 0; a < 2; a++) {
+        const int dRow = (afAzimuths[a] == 0) ? -1 : 0;
+        const int dCol = (afAzimuths[a] == 0) ? 0 : 1;
+        std::vector<int> bands(1, 1);
+        BandRowReader reader(poDS, bands);
+        ShadowSweep   sweep(nXSize, nYSize, 1, cellSize, -cellSize, 1.0f, z,
+                            afAzimuths[a], alt, zMax - zMin);
+        bool          bOK = true;
+        int           nShadows = 0;
+
+        for (int r = 0; r < nYSize; r++) {
+            const int    i = (r + 300) % nYSize;
+            const GByte *shadowRow = sweep.GetRow(reader, 0, i);
+            for (int j = 0; j < nXSize; j++) {
+                const float v = values[i * nXSize + j];
+                bool        inShadow = false;
+                for (int d = 1; v != noData && !inShadow; d++) {
+                    const int y = i + d * dRow;
+                    const int x = j + d * dCol;
+                    if (y < 0 || x >= nXSize)
+                        break;
+                    const float w = values[y * nXSize + x];
+                    inShadow = w != noData && w * z - d * drop > v * z + 1e-6;
+                }
+                if (((shadowRow[j >> 3] >> (j & 7)) & 1) != (inShadow ? 1 : 0))
+                    bOK = false;
+                nShadows += inShadow ? 1 : 0;
+            }
+        }
+        Check(bOK && nShadows > 0,
+              CPLSPrintf("ShadowSweep with the sun at azimuth %g", afAzimuths[a]));
+    }
+
+    // A strip's shadows don't change when the rows GetInputRows leaves out
+    // are nodata
+    const float afStripAzimuths[] = { 0, 180 };
+    for (int a = 0; a < 2; a++) {
+        std::vector<int> bands(1, 1);
+        BandRowReader reader(poDS, bands);
+        ShadowSweep   sweep(nXSize, nYSize, 1, cellSize, -cellSize, 1.0f, z,
+                            afStripAzimuths[a], alt, zMax - zMin);
+        int           iReadFirst, iReadLast;
+        sweep.GetInputRows(300, 340, &iReadFirst, &iReadLast);
+
+        std::vector<float> stripValues(values.size(), noData);
+        for (int i = iReadFirst; i <= iReadLast; i++)
+            for (int j = 0; j < nXSize; j++)
+                stripValues[i * nXSize + j] = values[i * nXSize + j];
+        GDALDataset  *poStripDS = CreateMemDEM(stripValues, nXSize, nYSize, true, noData);
+        BandRowReader stripReader(poStripDS, bands);
+        ShadowSweep   stripSweep(nXSize, nYSize, 1, cellSize, -cellSize, 1.0f, z,
+                                 afStripAzimuths[a], alt, zMax - zMin);
+        bool          bOK = iReadLast - iReadFirst < nYSize - 1;
+
+        for (int i = 300; i <= 340; i++)
+            if (memcmp(sweep.GetRow(reader, 0, i), stripSweep.GetRow(stripReader, 0, i),
+                       (nXSize + 7) / 8) != 0)
+                bOK = false;
+        Check(bOK, CPLSPrintf("ShadowSweep input rows with the sun at azimuth %g",
+                              afStripAzimuths[a]));
+        GDALClose(poStripDS);
+    }
+    GDALClose(poDS);
+}
+
+/* -----------------------------------------
+ * Color scale palette: every elevation's entry has its color, nodata
+ * and null get their own entries, too many colors or a float DEM fall
+ * back to RGB
+ */
+static void SetColorScale(const char *pszScale)
+{
+    for (size_t k = 0; k < ColorPointList.size(); k++)
+        delete ColorPointList[k];
+    ColorPointList.clear();
+    HasNoDataColor = false;
+    ClampBelowScale = false;
+    ClampAboveScale = false;
+
+    VSILFILE *fp = VSIFOpenL("checks_scale.txt", "wb");
+    if (fp != NULL) {
+        VSIFWriteL(pszScale, 1, strlen(pszScale), fp);
+        VSIFCloseL(fp);
+    }
+    ReadColorScale("checks_scale.txt");
+    VSIUnlink("checks_scale.txt");
+}
+
+static bool SameColor(const GDALColorEntry *psEntry, const SColor &color)
+{
+    return psEntry != NULL && psEntry->c1 == color.Red &&
+           psEntry->c2 == color.Green && psEntry->c3 == color.Blue;
+}
+
+static void CheckPalette()
+{
+    std::vector<GByte> lut;
+    int                lutMin;
+    GByte              noDataIndex;
+
+    SetColorScale("10 0 0 0\n10.5 10 20 30\n100 210 120 30\nnv 5 5 5\n");
+    GDALColorTable colorTable;
+    bool bOK = BuildPalette(GDT_Byte, &colorTable, lut, lutMin, noDataIndex, false, 1e6);
+    Check(bOK && noDataIndex == 1 && SameColor(colorTable.GetColorEntry(1), NoDataColor) &&
+          colorTable.GetColorEntry(0)->c4 == 255, "BuildPalette nodata entry");
+
+    // Elevations beyond the table take its first or last entry
+    for (int n = -50; bOK && n < (int) lut.size() + 50; n++) {
+        const int    k = (n < 0) ? 0 : (n >= (int) lut.size()) ? (int) lut.size() - 1 : n;
+        const SColor color = GetColor((float) (lutMin + n));
+        if (color.Red == 0 && color.Green == 0 && color.Blue == 0)
+            bOK = lut[k] == 0;
+        else
+            bOK = lut[k] > noDataIndex && SameColor(colorTable.GetColorEntry(lut[k]), color);
+    }
+    Check(bOK, "BuildPalette entries have the elevations' colors");
+
+    GDALColorTable alphaTable;
+    Check(BuildPalette(GDT_Int16, &alphaTable, lut, lutMin, noDataIndex, true, 1e6) &&
+          alphaTable.GetColorEntry(0)->c4 == 0 && alphaTable.GetColorEntry(1)->c4 == 0 &&
+          alphaTable.GetColorEntry(2)->c4 == 255, "BuildPalette -alpha entries");
+
+    SetColorScale("0 0 0 0\n100 200 100 50\n");
+    GDALColorTable blackTable;
+    Check(BuildPalette(GDT_UInt16, &blackTable, lut, lutMin, noDataIndex, false, 1e6) &&
+          noDataIndex == 0, "BuildPalette nodata shares the null entry without nv");
+    Check(!BuildPalette(GDT_Float32, &blackTable, lut, lutMin, noDataIndex, false, 1e6),
+          "BuildPalette refuses a float DEM");
+    Check(!BuildPalette(GDT_Int16, &blackTable, lut, lutMin, noDataIndex, false, 50),
+          "BuildPalette refuses a table over the size limit");
+
+    SetColorScale("0 1 1 1\n1000 255 1 1\n2000 255 255 1\n");
+    GDALColorTable fullTable;
+    Check(!BuildPalette(GDT_Int16, &fullTable, lut, lutMin, noDataIndex, false, 1e6),
+          "BuildPalette refuses more than 256 colors");
+    SetColorScale("");
+}
+
+/* -----------------------------------------
+ * Composite blending: the three modes, and never the null color
+ */
+static void CheckBlendChannel()
+{
+    Check(BlendChannel(200, 255, BLEND_MULTIPLY, 0.5f) == 200 &&
+          BlendChannel(200, 128, BLEND_MULTIPLY, 0.5f) == 100,
+          "BlendChannel multiply");
+    Check(BlendChannel(100, 255, BLEND_OVERLAY, 0.5f) == 200 &&
+          BlendChannel(100, 128, BLEND_OVERLAY, 0.5f) == 100 &&
+          BlendChannel(200, 1, BLEND_OVERLAY, 0.5f) == 145 &&
+          BlendChannel(200, 255, BLEND_OVERLAY, 0.5f) == 255,
+          "BlendChannel overlay");
+    Check(BlendChannel(200, 100, BLEND_ALPHA, 0.0f) == 200 &&
+          BlendChannel(200, 100, BLEND_ALPHA, 1.0f) == 100 &&
+          BlendChannel(200, 100, BLEND_ALPHA, 0.25f) == 175,
+          "BlendChannel alpha uses the opacity");
+    Check(BlendChannel(0, 200, BLEND_MULTIPLY, 0.5f) == 1 &&
+          BlendChannel(100, 1, BLEND_MULTIPLY, 0.5f) == 1 &&
+          BlendChannel(0, 1, BLEND_ALPHA, 0.0f) == 1,
+          "BlendChannel keeps blended cells off the null color");
+}
+
+/* -----------------------------------------
+ * Output sinks: rows arrive in order, through the writer thread too
+ */
+struct CollectedRows
+{
+    std::vector<int>   keys;      // 100 * row + band, in the order received
+    std::vector<float> values;
+    size_t             nFailAt;   // refuse the row after this many
+};
+
+static bool CollectRow(void *pUserData, int iBand, int iRow, void *pData,
+                       GDALDataType eBufType, int nXSize)
+{
+    CollectedRows *psRows = (CollectedRows *) pUserData;
+    if (psRows->keys.size() == psRows->nFailAt)
+        return false;
+
+    std::vector<float> row(nXSize);
+    GDALCopyWords(pData, eBufType, GDALGetDataTypeSize(eBufType) / 8,
+                  &row[0], GDT_Float32, sizeof(float), nXSize);
+    psRows->keys.push_back(100 * iRow + iBand);
+    psRows->values.insert(psRows->values.end(), row.begin(), row.end());
+    return true;
+}
+
+// Write every band of every row, value 10 * row + band in every column
+static bool WriteRows(OutputSink *poSink)
+{
+    std::vector<float> row(poSink->GetXSize());
+    for (int i = 0; i < poSink->GetYSize(); i++)
+        for (int b = 1; b <= poSink->GetBandCount(); b++) {
+            row.assign(row.size(), (float) (10 * i + b));
+            if (!poSink->WriteRow(b, i, &row[0], GDT_Float32))
+                return false;
+        }
+    return poSink->Flush();
+}
+
+static bool InOrder(const CollectedRows &rows, int nXSize, int nYSize, int nBands)
+{
+    if ((int) rows.keys.size() != nYSize * nBands)
+        return false;
+    for (int i = 0; i < nYSize; i++)
+        for (int b = 1; b <= nBands; b++) {
+            const int k = i * nBands + b - 1;
+            if (rows.keys[k] != 100 * i + b ||
+                rows.values[k * nXSize + nXSize - 1] != 10 * i + b)
+                return false;
+        }
+    return true;
+}
+
+static void CheckOutputSinks()
+{
+    const int nXSize = 5, nYSize = 40, nBands = 2;
+
+    CollectedRows rows;
+    rows.nFailAt = (size_t) -1;
+    OutputSink *poSink = new CallbackOutputSink(CollectRow, &rows, nXSize, nYSize,
+                                                nBands, GDT_Float32);
+    Check(WriteRows(poSink) && InOrder(rows, nXSize, nYSize, nBands),
+          "CallbackOutputSink gets every row in order");
+    delete poSink;
+
+    CollectedRows queued;
+    queued.nFailAt = (size_t) -1;
+    poSink = new AsyncOutputSink(new CallbackOutputSink(CollectRow, &queued, nXSize,
+                                     nYSize, nBands, GDT_Float32), 3);
+    Check(WriteRows(poSink) && InOrder(queued, nXSize, nYSize, nBands),
+          "AsyncOutputSink passes rows on in order");
+    delete poSink;
+
+    CollectedRows failing;
+    failing.nFailAt = 7;
+    poSink = new AsyncOutputSink(new CallbackOutputSink(CollectRow, &failing, nXSize,
+                                     nYSize, nBands, GDT_Float32), 3);
+    Check(!WriteRows(poSink) && failing.keys.size() == failing.nFailAt,
+          "AsyncOutputSink reports a failed write");
+    delete poSink;
+
+    // Raw BIL file: rows out of order are refused, values clamped to Int16
+    RawOutputSink *poRaw = new RawOutputSink("checks_raw.bil", 3, 2, 2, GDT_Int16);
+    const float afRow[3] = { -1.0f, 7.0f, 40000.0f };
+    bool        bOK = poRaw->IsOpen() &&
+                      poRaw->WriteRow(1, 0, (void *) afRow, GDT_Float32) &&
+                      !poRaw->WriteRow(1, 1, (void *) afRow, GDT_Float32) &&
+                      poRaw->WriteRow(2, 0, (void *) afRow, GDT_Float32) &&
+                      !poRaw->WriteRow(2, 1, (void *) afRow, GDT_Float32) &&
+                      poRaw->WriteRow(1, 1, (void *) afRow, GDT_Float32) &&
+                      poRaw->WriteRow(2, 1, (void *) afRow, GDT_Float32);
+    poRaw->SetNoDataValue(-9999);
+    delete poRaw;
+
+    GInt16    anData[13];
+    VSILFILE *fp = VSIFOpenL("checks_raw.bil", "rb");
+    const size_t nRead = (fp != NULL) ? VSIFReadL(anData, sizeof(GInt16), 13, fp) : 0;
+    if (fp != NULL)
+        VSIFCloseL(fp);
+    Check(bOK && nRead == 12 && anData[0] == -1 && anData[1] == 7 &&
+          anData[2] == 32767 && anData[11] == 32767,
+          "RawOutputSink writes rows in order and refuses others");
+
+    char **papszHeader = CSLLoad("checks_raw.bil.hdr");
+    Check(CSLFindString(papszHeader, "interleave = bil") >= 0 &&
+          CSLFindString(papszHeader, "data ignore value = -9999") >= 0,
+          "RawOutputSink ENVI header");
+    CSLDestroy(papszHeader);
+    VSIUnlink("checks_raw.bil");
+    VSIUnlink("checks_raw.bil.hdr");
+}
+
+/* -----------------------------------------
+ * Checkpoint: an interrupted run resumes with its statistics, unless an
+ * input or an argument changed
+ */
+static void WriteText(const char *pszFilename, const char *pszText)
+{
+    VSILFILE *fp = VSIFOpenL(pszFilename, "wb");
+    if (fp != NULL) {
+        VSIFWriteL(pszText, 1, strlen(pszText), fp);
+        VSIFCloseL(fp);
+    }
+}
+
+// Start the checkpointed run of the arguments; the row it starts at, or
+// -1 if it can't be checkpointed
+static int ResumeRun(char **papszArgv, std::vector<DemStats> &stats,
+                     const char *pszOtherInput = NULL)
+{
+    Checkpoint checkpoint;
+    checkpoint.Enable(papszArgv[2], "GTiff", papszArgv[1], CSLCount(papszArgv), papszArgv);
+    if (pszOtherInput != NULL)
+        checkpoint.AddInput(pszOtherInput);
+    if (!checkpoint.IsEnabled())
+        return -1;
+
+    int iStartRow;
+    checkpoint.SetStats(&stats);
+    delete checkpoint.Resume(4, 10, 0, &iStartRow);
+    return iStartRow;
+}
+
+static void CheckCheckpoint()
+{
+    WriteText("checks_in.txt", "input");
+    WriteText("checks_scale.txt", "0 0 0 0");
+    GDALDriver  *poDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
+    GDALDataset *poDS = (poDriver != NULL) ?
+        poDriver->Create("checks_out.tif", 4, 10, 1, GDT_Float32, NULL) : NULL;
+    if (poDS == NULL) {
+        Check(false, "Checkpoint: create a GTiff output");
+        return;
+    }
+    OutputSink *poOut = new GDALOutputSink(poDS, GDT_Float32);
+
+    char **papszArgv = CSLTokenizeString2("tool checks_in.txt checks_out.tif -resume -ci 0 -z 2",
+                                          " ", 0);
+    std::vector<DemStats> stats(2);
+    {
+        Checkpoint checkpoint;
+        checkpoint.Enable(papszArgv[2], "GTiff", papszArgv[1], CSLCount(papszArgv), papszArgv);
+        checkpoint.AddInput("checks_scale.txt");
+        checkpoint.SetInterval(0);
+        checkpoint.SetStats(&stats);
+        for (int i = 0; i < 6; i++) {
+            stats[0].Add(i);
+            stats[1].Add(2 * i);
+            stats[0].AddRows(1);
+            stats[1].AddRows(1);
+            checkpoint.RowDone(poOut, i + 1);
+        }
+    }
+    delete poOut;
+
+    std::vector<DemStats> resumed(2);
+    Check(ResumeRun(papszArgv, resumed, "checks_scale.txt") == 6 &&
+          SameStats(resumed[0], stats[0]) && SameStats(resumed[1], stats[1]),
+          "Checkpoint resumes at the saved row with its statistics");
+
+    std::vector<DemStats> fresh(2);
+    Check(ResumeRun(papszArgv, fresh) == 0,
+          "Checkpoint doesn't resume without an input it was saved with");
+
+    char **papszOther = CSLDuplicate(papszArgv);
+    CPLFree(papszOther[7]);
+    papszOther[7] = CPLStrdup("3");
+    Check(ResumeRun(papszOther, fresh, "checks_scale.txt") == 0,
+          "Checkpoint doesn't resume with other arguments");
+    CSLDestroy(papszOther);
+
+    WriteText("checks_scale.txt", "0 0 0 0\n100 255 255 255");
+    Check(ResumeRun(papszArgv, fresh, "checks_scale.txt") == 0,
+          "Checkpoint doesn't resume when an input changed");
+
+    Check(ResumeRun(papszArgv, fresh, "checks_missing.txt") == -1,
+          "Checkpoint is off when an input can't be checked");
+
+    CSLDestroy(papszArgv);
+    const char *apszFiles[] = { "checks_in.txt", "checks_scale.txt", "checks_out.tif",
+                                "checks_out.tif.ckpt" };
+    for (size_t k = 0; k < sizeof(apszFiles) / sizeof(apszFiles[0]); k++)
+        VSIUnlink(apszFiles[k]);
+}
+
+/* -----------------------------------------
+ * Run a tool built next to this program, arguments separated by spaces
+ */
+static bool RunTool(const char *pszTool, const char *pszArgs)
+{
+    const std::string osTool = CPLFormFilename(osToolDir.c_str(), pszTool, NULL);
+    char **papszArgv = CSLAddString(NULL, osTool.c_str());
+    char **papszArgs = CSLTokenizeString2(pszArgs, " ", 0);
+
+    for (int k = 0; papszArgs != NULL && papszArgs[k] != NULL; k++)
+        papszArgv = CSLAddString(papszArgv, papszArgs[k]);
+    CSLDestroy(papszArgs);
+
+    CPLSpawnedProcess *p = CPLSpawnAsync(NULL, papszArgv, FALSE, FALSE, FALSE, NULL);
+    CSLDestroy(papszArgv);
+    return p != NULL && CPLSpawnAsyncFinish(p, TRUE, FALSE) == 0;
+}
+
+// A small DEM: a ramp with a hill and a nodata cell
+static bool CreateCheckDEM(const char *pszFilename, int nXSize, int nYSize,
+                           float noData = -9999)
+{
+    GDALDriver  *poDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
+    GDALDataset *poDS = (poDriver != NULL) ?
+        poDriver->Create(pszFilename, nXSize, nYSize, 1, GDT_Float32, NULL) : NULL;
+    if (poDS == NULL)
+        return false;
+
+    double adfGeoTransform[6] = { 1000, 10, 0, 5000, 0, -10 };
+    std::vector<float> values(nXSize * nYSize);
+    for (int i = 0; i < nYSize; i++)
+        for (int j = 0; j < nXSize; j++)
+            values[i * nXSize + j] = (float) (200 + 4 * i + 2 * j +
+                50 * exp(-((i - 6) * (i - 6) + (j - 9) * (j - 9)) / 12.0));
+    values[3 * nXSize + 3] = noData;
+
+    poDS->SetGeoTransform(adfGeoTransform);
+    poDS->GetRasterBand(1)->SetNoDataValue(noData);
+    poDS->GetRasterBand(1)->RasterIO( GF_Write, 0, 0, nXSize, nYSize,
+                                      &values[0], nXSize, nYSize, GDT_Float32, 0, 0 );
+    GDALClose(poDS);
+    return true;
+}
+
+// One cell of band 1, or NaN if the raster cannot be read
+static double ReadCell(const char *pszFilename, int iCol, int iRow)
+{
+    GDALDataset *poDS = (GDALDataset *) GDALOpen(pszFilename, GA_ReadOnly);
+    float        value = (float) NAN;
+    if (poDS == NULL)
+        return value;
+    if (poDS->GetRasterBand(1)->RasterIO( GF_Read, iCol, iRow, 1, 1,
+                                          &value, 1, 1, GDT_Float32, 0, 0 ) != CE_None)
+        value = (float) NAN;
+    GDALClose(poDS);
+    return value;
+}
+
+/* -----------------------------------------
+ * Tools: -stats from a gradient raster counts every row, invalid
+ * cells are -9999 whatever the input nodata
+ */
+static void CheckTools()
+{
+    const int nYSize = 15;
+
+    if (!CreateCheckDEM("checks_dem.tif", 20, nYSize)) {
+        Check(false, "Tools: create a GTiff DEM");
+        return;
+    }
+
+    DemStats slopeStats;
+    Check(RunTool("hillshade", "checks_dem.tif checks_shade.tif -savegrad checks_grad.tif") &&
+          RunTool("slope", "checks_grad.tif checks_slope.tif -stats checks_slope.csv") &&
+          slopeStats.ReadReport("checks_slope.csv") && slopeStats.GetRows() == nYSize,
+          "slope -stats from a gradient raster covers every row");
+
+    Check(CreateCheckDEM("checks_dem2.tif", 20, nYSize, -32768) &&
+          RunTool("slope", "checks_dem2.tif checks_slope2.tif") &&
+          RunTool("aspect", "checks_dem2.tif checks_aspect2.tif") &&
+          ReadCell("checks_slope2.tif", 0, 0) == -9999 &&
+          ReadCell("checks_slope2.tif", 4, 4) == -9999 &&
+          ReadCell("checks_aspect2.tif", 4, 4) == -9999 &&
+          ReadCell("checks_slope2.tif", 8, 8) != -9999,
+          "slope and aspect write -9999 for invalid cells of any input nodata");
+
+    const char *apszFiles[] = { "checks_dem.tif", "checks_shade.tif", "checks_grad.tif",
+                                "checks_slope.tif", "checks_slope.csv", "checks_dem2.tif",
+                                "checks_slope2.tif", "checks_aspect2.tif" };
+    for (size_t k = 0; k < sizeof(apszFiles) / sizeof(apszFiles[0]); k++)
+        VSIUnlink(apszFiles[k]);
+}
+
+int main(int nArgc, char ** papszArgv)
+{
+    (void) nArgc;
+
+    osToolDir = CPLGetPath(papszArgv[0]);
+    GDALAllRegister();
+
+    CheckDemStats();
+    CheckGradientEncoding();
+    CheckGradientBands();
+    CheckRowWindow();
+    CheckNoDataMasks();
+    CheckBoxSums();
+    CheckCreationOptions();
+    CheckSelectBands();
+    CheckPalette();
+    CheckBlendChannel();
+    CheckShadowSweep();
+    CheckOutputSinks();
+    CheckCheckpoint();
+    CheckTools();
+
+    printf("%d of %d checks passed\n", nChecks - nFailed, nChecks);
+    return nFailed;
+}
@@ -29,171 +29,65 @@
 
 #include <iostream>
 #include <stdlib.h>
-#include <fstream>
-#include <list>
+#include <math.h>
 #include "gdal_priv.h"
-#include "stringtok.h"
+#include "colorscale.h"
+#include "shade.h"
+#include "rowwindow.h"
+#include "membudget.h"
+#include "demoutput.h"
+#include "checkpoint.h"
 
 using namespace std;
 
-struct SColor
-{
-  int Red;
-  int Green;
-  int Blue;
-};
-
-struct SColorPoint
-{
-  int Elevation;
-  SColor Color;
-};
-
-vector<SColorPoint*> ColorPointList;
-
-//=============================================================================
-void ReadColorScale(const string& ScaleFileName)
-{
-  ifstream ScaleFile;
-  string Buffer;
-  list<string> StringList;
-  SColorPoint* TempColorPoint;
-
-  ScaleFile.open(ScaleFileName.c_str(), ios::in);
-
-  if (!ScaleFile.is_open())
-  {
-    cout << "Error opening color scale file : " << ScaleFileName << endl;
-    exit (1);
-  }
-
-  while (!ScaleFile.eof())
-  {
-    StringList.clear();
-    getline(ScaleFile, Buffer);
-
-    // Strip spaces in case we have a blank line
-    while (Buffer[0] == ' ')
-    {
-      Buffer.erase(0);
-    }
-
-    // If not a blank line
-    if (Buffer != "")
-    {
-      TempColorPoint = new SColorPoint;
-      stringtok(StringList, Buffer, " ");
-      list<string>::iterator i = StringList.begin();
-      TempColorPoint->Elevation = atoi(string(*i).c_str());
-      i++;
-      TempColorPoint->Color.Red = atoi(string(*i).c_str());
-      i++;
-      TempColorPoint->Color.Green = atoi(string(*i).c_str());
-      i++;
-      TempColorPoint->Color.Blue = atoi(string(*i).c_str());
-
-      ColorPointList.push_back(TempColorPoint);
-    }
-  }
-
-  ScaleFile.close();
-}
-
-//=============================================================================
-// Given an elevation calculate a color based on the color points table
-// At the moment we're only doing linear color gradients
-//=============================================================================
-SColor GetColor(float Elevation)
-{
-  SColor Color = {0,0,0};
-  SColorPoint* LowerColorPoint = NULL;
-  SColorPoint* UpperColorPoint = NULL;
-  SColorPoint* TempColorPoint;
-  float TempElev;
-  float DiffFactor;
-
-  // Find closest pair of color points that the elevation falls between
-  // Lower color point
-  TempElev = -64000;
-  for (unsigned int i = 0; i < ColorPointList.size(); i++)
-  {
-    TempColorPoint = ColorPointList[i];
-    if ((TempColorPoint->Elevation <= Elevation) && (TempElev < TempColorPoint->Elevation))
-    {
-      TempElev = TempColorPoint->Elevation;
-      LowerColorPoint = TempColorPoint;
-    }
-  }
-  // Upper color point
-  TempElev = 64000;
-  for (unsigned int i = 0; i < ColorPointList.size(); i++)
-  {
-    TempColorPoint = ColorPointList[i];
-    if ((TempColorPoint->Elevation >= Elevation) && (TempElev > TempColorPoint->Elevation))
-    {
-      TempElev = TempColorPoint->Elevation;
-      UpperColorPoint = TempColorPoint;
-    }
-  }
-
-  // I should change the following clipping logic to use the color scale instead
-  // Return blue
-  if (LowerColorPoint == NULL)
-  {
-    Color.Red = 150;
-    Color.Green = 150;
-    Color.Blue = 255;
-    return Color;
-  }
-
-  // Return white
-  if (UpperColorPoint == NULL)
-  {
-    Color.Red = 255;
-    Color.Green = 255;
-    Color.Blue = 255;
-    return Color;
-  }
-
-  // Work out the factor the elevation is between the lower and upper color point elevations
-  // If the upper and lower color points point to the same color point object then
-  // it means that the elevation falls exactly on a color point
-  if (LowerColorPoint != UpperColorPoint)
-  {
-    DiffFactor = (Elevation - LowerColorPoint->Elevation) / (UpperColorPoint->Elevation - LowerColorPoint->Elevation);
-    Color.Red   = (int)((UpperColorPoint->Color.Red - LowerColorPoint->Color.Red) * DiffFactor) + LowerColorPoint->Color.Red;
-    Color.Green = (int)((UpperColorPoint->Color.Green - LowerColorPoint->Color.Green) * DiffFactor) + LowerColorPoint->Color.Green;
-    Color.Blue  = (int)((UpperColorPoint->Color.Blue - LowerColorPoint->Color.Blue) * DiffFactor) + LowerColorPoint->Color.Blue;
-  }
-  else
-  {
-    Color.Red   = LowerColorPoint->Color.Red;
-    Color.Green = LowerColorPoint->Color.Green;
-    Color.Blue  = LowerColorPoint->Color.Blue;
-  }
-
-  return Color;
-}
-
 //=============================================================================
 int main(int argc, char* argv[])
 {
   GDALDataset* poDataset;
   double       adfGeoTransform[6];
-  float*       RowRed;
-  float*       RowGreen;
-  float*       RowBlue;
+  const float* RowIn;
+  GByte*       RowRed = NULL;
+  GByte*       RowGreen = NULL;
+  GByte*       RowBlue = NULL;
+  GByte*       RowAlpha = NULL;
+  GByte*       RowIndex = NULL;
   float        InPixel;
   int          i;
   int          j;
   const char*  Format = "GTiff";
+  char**       Options = NULL;
+  bool         Resume = false;
+  Checkpoint   Ckpt;
+  int          YOff = 0;
+  int          OutRows = -1;
+  int          InBand = 1;
   SColor       TempColor;
-
-  if (argc < 3)
+  bool         Paletted = false;
+  bool         Alpha = false;
+  vector<GByte> Lut;
+  int          LutMin = 0;
+  int          LutMax = 0;
+  GByte        NoDataIndex = 0;
+  double       MaxLutSize = 16 * 1024 * 1024;
+  MemBudget    Budget;
+  bool         Composite = false;
+  EBlendMode   BlendMode = BLEND_MULTIPLY;
+  float        Opacity = 0.5;
+  float        z = 1.0;
+  float        scale = 1.0;
+  float        az = 315.0;
+  float        alt = 45.0;
+  int          winDist = 1;
+  float        sharp = 2;
+
+  if (argc < 4)
   {
     cout << "color-relief generates a color relief map from any GDAL-supported elevation raster." << endl;
     cout << endl << "Usage:" << endl;
-    cout << "color-relief <input_dem> <input_color_scale> <output_relief_map>" << endl << endl;
+    cout << "color-relief <input_dem> <input_color_scale> <output_relief_map> [-palette] [-alpha] [-of GTiff|RAW] [-co NAME=VALUE]* [-mem MB]" << endl;
+    cout << "             [-resume [-ci seconds]] [-rows first count] [-b band]" << endl;
+    cout << "             [-hillshade [-blend multiply|overlay|alpha] [-opacity 0-1 (default=0.5)]" << endl;
+    cout << "              [-z ZFactor] [-s scale] [-az Azimuth] [-alt Altitude] [-wd Halfsize] [-sh Sharpness]]" << endl << endl;
     cout << "The input color scale is a file containing a set of elevation points (in meters)" << endl;
     cout << "and colors. Typically only a small number of elevation and color sets will be needed" << endl;
     cout << "and the rest will be interpolated by color-relief." << endl;
@@ -203,6 +97,26 @@ int main(int argc, char* argv[])
     cout << "Using true black (0 0 0) as your RGB values will yield blank/null cells." << endl;
     cout << "Note that to remove nodata from the output, set the DEM's nodata value to rgb of 0 0 0:" << endl;
     cout << "-32767 0 0 0" << endl << endl;
+    cout << "Elevations may also be given as a percentage of the DEM's value range" << endl;
+    cout << "(estimated from overviews or a sample), and \"nv\" sets the nodata color:" << endl;
+    cout << "100% 255 255 255" << endl;
+    cout << "0% 0 255 0" << endl;
+    cout << "nv 0 0 0" << endl << endl;
+    cout << "-palette writes a single band with a color table instead of RGB for integer DEMs." << endl;
+    cout << "RGB is still written if the scale needs more than 256 colors; prefer an \"nv\"" << endl;
+    cout << "entry over a far away nodata color point to keep the color count down." << endl << endl;
+    cout << "-alpha adds an alpha band (RGBA), transparent on nodata and null cells; with" << endl;
+    cout << "-palette those color table entries are made transparent instead." << endl << endl;
+    cout << "-hillshade blends the color relief with a shaded relief computed in the same pass" << endl;
+    cout << "(see hillshade for the shading options) and writes the composite as RGB." << endl << endl;
+    cout << "An output of - streams raw Byte rows (band interleaved by line) to stdout." << endl;
+    cout << "-co passes creation options to the driver, e.g. -co COMPRESS=DEFLATE -co TILED=YES;" << endl;
+    cout << "GTiff compression then runs on all CPUs unless NUM_THREADS is given." << endl << endl;
+    cout << "-resume saves a checkpoint next to the output every 300 seconds (-ci seconds)" << endl;
+    cout << "and, when rerun with the same arguments, carries on from the last checkpoint." << endl << endl;
+    cout << "-rows computes just that strip of the output, reading the rows around it from" << endl;
+    cout << "the input (used by demshard)." << endl << endl;
+    cout << "-b colors that band of the input instead of the first." << endl << endl;
     cout << "See the accompanying \"scale.txt\" file for a decent example." << endl;
     exit(1);
   }
@@ -211,6 +125,58 @@ int main(int argc, char* argv[])
   const string ScaleFilename = argv[2];
   const char* OutFilename = argv[3];
 
+  for (int iArg = 4; iArg < argc; iArg++)
+  {
+    if (EQUAL(argv[iArg], "-palette"))
+      Paletted = true;
+    if (EQUAL(argv[iArg], "-alpha"))
+      Alpha = true;
+    if (EQUAL(argv[iArg], "-of") && iArg + 1 < argc)
+      Format = argv[iArg+1];
+    if (EQUAL(argv[iArg], "-co") && iArg + 1 < argc)
+      Options = AddCreationOption(Options, argv[iArg+1]);
+    if (EQUAL(argv[iArg], "-resume"))
+      Resume = true;
+    if (EQUAL(argv[iArg], "-ci") && iArg + 1 < argc)
+      Ckpt.SetInterval(atoi(argv[iArg+1]));
+    if (EQUAL(argv[iArg], "-rows") && iArg + 2 < argc)
+    {
+      YOff = atoi(argv[iArg+1]);
+      OutRows = atoi(argv[iArg+2]);
+    }
+    if (EQUAL(argv[iArg], "-mem") && iArg + 1 < argc)
+      Budget.Set(argv[iArg+1]);
+    if (EQUAL(argv[iArg], "-b") && iArg + 1 < argc)
+      InBand = atoi(argv[iArg+1]);
+    if (EQUAL(argv[iArg], "-hillshade"))
+      Composite = true;
+    if (EQUAL(argv[iArg], "-blend") && iArg + 1 < argc)
+    {
+      if (EQUAL(argv[iArg+1], "overlay"))
+        BlendMode = BLEND_OVERLAY;
+      else if (EQUAL(argv[iArg+1], "alpha"))
+        BlendMode = BLEND_ALPHA;
+      else
+        BlendMode = BLEND_MULTIPLY;
+    }
+    if (EQUAL(argv[iArg], "-opacity") && iArg + 1 < argc)
+      Opacity = atof(argv[iArg+1]);
+    if (EQUAL(argv[iArg], "-z") && iArg + 1 < argc)
+      z = atof(argv[iArg+1]);
+    if ((EQUAL(argv[iArg], "-s") || EQUAL(argv[iArg], "-scale")) && iArg + 1 < argc)
+      scale = atof(argv[iArg+1]);
+    if ((EQUAL(argv[iArg], "-az") || EQUAL(argv[iArg], "-azimuth")) && iArg + 1 < argc)
+      az = atof(argv[iArg+1]);
+    if ((EQUAL(argv[iArg], "-alt") || EQUAL(argv[iArg], "-altitude")) && iArg + 1 < argc)
+      alt = atof(argv[iArg+1]);
+    if ((EQUAL(argv[iArg], "-wd") || EQUAL(argv[iArg], "-windist")) && iArg + 1 < argc)
+      winDist = atoi(argv[iArg+1]);
+    if ((EQUAL(argv[iArg], "-sh") || EQUAL(argv[iArg], "-sharpness")) && iArg + 1 < argc)
+      sharp = atof(argv[iArg+1]);
+  }
+
+  Options = ApplyCreationDefaults(Options, Format);
+
   // Open and read color scale file
   ReadColorScale(ScaleFilename);
 
@@ -220,60 +186,204 @@ int main(int argc, char* argv[])
   poDataset = (GDALDataset*) GDALOpen(InFilename, GA_ReadOnly);
   if(poDataset == NULL)
   {
-    cout << "Couldn't open dataset " << InFilename << endl;
+    cerr << "Couldn't open dataset " << InFilename << endl;
+    exit(1);
   }
 
+  if (InBand < 1 || InBand > poDataset->GetRasterCount())
+  {
+    cerr << "Band " << InBand << " is not in the input (1 to " << poDataset->GetRasterCount() << ")" << endl;
+    exit(1);
+  }
   GDALRasterBand *poBand;
-  poBand = poDataset->GetRasterBand(1);
+  poBand = poDataset->GetRasterBand(InBand);
   poDataset->GetGeoTransform(adfGeoTransform);
+  ResolvePercentPoints(poBand);
 
   // Get variables from input dataset
   const int nXSize = poBand->GetXSize();
   const int nYSize = poBand->GetYSize();
-  RowRed    = (float *) CPLMalloc(sizeof(float)*nXSize);
-  RowGreen  = (float *) CPLMalloc(sizeof(float)*nXSize);
-  RowBlue   = (float *) CPLMalloc(sizeof(float)*nXSize);
+  if (OutRows < 0)
+    OutRows = nYSize - YOff;
+  if (YOff < 0 || OutRows < 1 || YOff + OutRows > nYSize)
+  {
+    cerr << "Rows " << YOff << " to " << YOff + OutRows - 1 << " are outside the input" << endl;
+    exit(1);
+  }
+  int HasInNoData;
+  const float InNoData = (float) poBand->GetNoDataValue(&HasInNoData);
+  const bool InNoDataIsNan = (InNoData != InNoData);
 
-  // Create the output dataset and copy over relevant metadata
-  GDALDriver *poDriver;
-  poDriver = GetGDALDriverManager()->GetDriverByName(Format);
-  GDALDataset      *poDS;
-  GDALRasterBand   *poBandRed;
-  GDALRasterBand   *poBandGreen;
-  GDALRasterBand   *poBandBlue;
-  char**           Options = NULL;
+  if (Paletted && Composite)
+  {
+    cerr << "-palette can't be combined with -hillshade, writing RGB" << endl;
+    Paletted = false;
+  }
 
-  poDS = poDriver->Create(OutFilename,nXSize,nYSize,3,GDT_Byte,Options);
-  poDS->SetGeoTransform(adfGeoTransform);
-  poDS->SetProjection(poDataset->GetProjectionRef());
+  // The palette lookup table may use up to a quarter of the memory budget
+  if (Budget.IsSet() && Budget.GetAvailable() / 4 < MaxLutSize)
+    MaxLutSize = (double)(Budget.GetAvailable() / 4);
 
-  poBandRed = poDS->GetRasterBand(1);
-  poBandRed->SetNoDataValue(0);
-  poBandGreen = poDS->GetRasterBand(2);
-  poBandGreen->SetNoDataValue(0);
-  poBandBlue = poDS->GetRasterBand(3);
-  poBandBlue->SetNoDataValue(0);
+  GDALColorTable ColorTable;
+  if (Paletted && !BuildPalette(poBand->GetRasterDataType(), &ColorTable, Lut, LutMin,
+                               NoDataIndex, Alpha, MaxLutSize))
+  {
+    cerr << "Palette not possible for this DEM and color scale, writing RGB" << endl;
+    Paletted = false;
+  }
+
+  // Mark the fourth band as alpha rather than an extra sample
+  if (Alpha && !Paletted && EQUAL(Format, "GTiff") && CSLFetchNameValue(Options, "ALPHA") == NULL)
+    Options = CSLSetNameValue(Options, "ALPHA", "YES");
+
+  OutputSink*      poOut;
+  const int QueueRows = Budget.PickQueueRows(sizeof(double)*nXSize, OUTPUT_QUEUE_ROWS);
+  Budget.Reserve(AsyncOutputSink::GetMemorySize(nXSize, QueueRows));
+
+  // The DEM is streamed through a window of rows: just the current row
+  // for plain color relief, the shading window for composite output
+  if (!Composite)
+    winDist = 0;
+  const int winSize = 2 * winDist + 1;
+  const double nsres = adfGeoTransform[5];
+  const double ewres = adfGeoTransform[1];
+  const int ChunkRows = Budget.PickChunkRows(poBand);
+  Budget.Reserve(BandRowReader::GetMemorySize(nXSize, 1, ChunkRows) +
+                 RowWindow::GetMemorySize(nXSize, winDist) +
+                 sizeof(float)*winSize*winSize +
+                 (Paletted ? Lut.size() + nXSize : 4 * nXSize));
+  if (!Budget.ApplyCacheMax())
+    exit(1);
+
+  // Create the output dataset and copy over relevant metadata
+  if (Resume)
+  {
+    Ckpt.Enable(OutFilename, Format, InFilename, argc, argv);
+    Ckpt.AddInput(ScaleFilename.c_str());
+  }
+  int StartRow;
+  poOut = Ckpt.Resume(nXSize, OutRows, QueueRows, &StartRow);
+  if (poOut == NULL)
+    poOut = CreateOutputSink(OutFilename, Format, nXSize, OutRows, Paletted ? 1 : (Alpha ? 4 : 3), GDT_Byte, Options, QueueRows);
+  if (poOut == NULL)
+  {
+    cerr << "Couldn't create output " << OutFilename << endl;
+    exit(1);
+  }
+  OffsetGeoTransform(adfGeoTransform, 0, YOff);
+  poOut->SetGeoTransform(adfGeoTransform);
+  poOut->SetProjection(poDataset->GetProjectionRef());
+  poOut->SetNoDataValue(0);
+
+  if (Paletted)
+    poOut->SetColorTable(&ColorTable);
+
+  BandRowReader Reader(poDataset, vector<int>(1, InBand), ChunkRows);
+  RowWindow    Window(&Reader, 0, winDist);
+  float*       win = (float *) CPLMalloc(sizeof(float)*winSize*winSize);
+  if (Paletted)
+  {
+    RowIndex = (GByte *) CPLMalloc(nXSize);
+    LutMax = LutMin + (int)Lut.size() - 1;
+  }
+  else
+  {
+    RowRed    = (GByte *) CPLMalloc(nXSize);
+    RowGreen  = (GByte *) CPLMalloc(nXSize);
+    RowBlue   = (GByte *) CPLMalloc(nXSize);
+    RowAlpha  = (GByte *) CPLMalloc(nXSize);
+  }
 
   // Run through each pixel in an image
-  for (i = 0; i < nYSize; i++)
+  for (i = YOff + StartRow; i < YOff + OutRows; i++)
   {
+    Window.Advance(i);
+    RowIn = Window.GetRow(0);
+
     for (j = 0; j < nXSize; j++)
     {
-      poBand->RasterIO(GF_Read, j, i, 1, 1, &InPixel, 1, 1, GDT_Float32, 0, 0);
-
-      TempColor = GetColor(InPixel);
-      RowRed[j]   = TempColor.Red;
-      RowGreen[j] = TempColor.Green;
-      RowBlue[j]  = TempColor.Blue;
+      InPixel = RowIn[j];
+      const bool IsNoData = HasInNoData &&
+          (InPixel == InNoData || (InNoDataIsNan && InPixel != InPixel));
+
+      if (Paletted)
+      {
+        if (IsNoData && (HasNoDataColor || Alpha))
+          RowIndex[j] = NoDataIndex;
+        else if (InPixel < LutMin)
+          RowIndex[j] = Lut[0];
+        else if (InPixel > LutMax)
+          RowIndex[j] = Lut[Lut.size() - 1];
+        else
+          RowIndex[j] = Lut[(int)InPixel - LutMin];
+        continue;
+      }
+
+      if (IsNoData && HasNoDataColor)
+      {
+        // The nodata color is used as it is, also in composite output
+        RowRed[j]   = NoDataColor.Red;
+        RowGreen[j] = NoDataColor.Green;
+        RowBlue[j]  = NoDataColor.Blue;
+      }
+      else if (Composite && !Window.IsValid(j))
+      {
+        // Edges and windows with nodata are null cells
+        RowRed[j] = RowGreen[j] = RowBlue[j] = 0;
+      }
+      else if (Composite)
+      {
+        Window.GetWindow(j, win);
+        const float Shade = ComputeShade(win, winDist, sharp, ewres, nsres, scale, z, az, alt);
+        TempColor = GetColor(InPixel);
+        RowRed[j]   = BlendChannel(TempColor.Red, Shade, BlendMode, Opacity);
+        RowGreen[j] = BlendChannel(TempColor.Green, Shade, BlendMode, Opacity);
+        RowBlue[j]  = BlendChannel(TempColor.Blue, Shade, BlendMode, Opacity);
+      }
+      else
+      {
+        TempColor = GetColor(InPixel);
+        RowRed[j]   = TempColor.Red;
+        RowGreen[j] = TempColor.Green;
+        RowBlue[j]  = TempColor.Blue;
+      }
+
+      const bool IsNull = (RowRed[j] == 0 && RowGreen[j] == 0 && RowBlue[j] == 0);
+      RowAlpha[j] = (IsNoData || IsNull) ? 0 : 255;
      }
 
     // Write lines to output raster
-    poBandRed->RasterIO(GF_Write, 0, i, nXSize, 1, RowRed, nXSize, 1, GDT_Float32, 0, 0);
-    poBandGreen->RasterIO(GF_Write, 0, i, nXSize, 1, RowGreen, nXSize, 1, GDT_Float32, 0, 0);
-    poBandBlue->RasterIO(GF_Write, 0, i, nXSize, 1, RowBlue, nXSize, 1, GDT_Float32, 0, 0);
+    bool Written;
+    if (Paletted)
+      Written = poOut->WriteRow(1, i - YOff, RowIndex, GDT_Byte);
+    else
+      Written = poOut->WriteRow(1, i - YOff, RowRed, GDT_Byte) &&
+                poOut->WriteRow(2, i - YOff, RowGreen, GDT_Byte) &&
+                poOut->WriteRow(3, i - YOff, RowBlue, GDT_Byte) &&
+                (!Alpha || poOut->WriteRow(4, i - YOff, RowAlpha, GDT_Byte));
+    if (!Written)
+    {
+      cerr << "Couldn't write " << OutFilename << endl;
+      exit(1);
+    }
+    Ckpt.RowDone(poOut, i - YOff + 1);
   }
 
-  delete poDS;
+  CPLFree(win);
+  CPLFree(RowIndex);
+  CPLFree(RowRed);
+  CPLFree(RowGreen);
+  CPLFree(RowBlue);
+  CPLFree(RowAlpha);
+  if (!poOut->Flush())
+  {
+    cerr << "Couldn't write " << OutFilename << endl;
+    exit(1);
+  }
+  delete poOut;
+  CSLDestroy(Options);
+  Ckpt.Finish();
+  ReportPeakRSS(Budget);
 
   return 0;
 }
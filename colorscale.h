@@ -0,0 +1,445 @@
+//=============================================================================
+// colorscale.h
+// Author  : Paul Surgeon
+// Date    : 2005-12-22
+// License : 
+/*
+ Copyright 2005 Paul Surgeon
+ Licensed under the Apache License, Version 2.0 (the "License"); 
+ you may not use this file except in compliance with the License. 
+ You may obtain a copy of the License at 
+ 
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software 
+ distributed under the License is distributed on an "AS IS" BASIS, 
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+ See the License for the specific language governing permissions and 
+ limitations under the License.
+ */
+//
+// The color scale of color-relief: the color points read from the scale
+// file, the color of an elevation, the palette built from them and the
+// blend of a color with a shade value. Kept out of color-relief.cpp so
+// the unit checks can use them.
+//=============================================================================
+
+#ifndef COLORSCALE_H
+#define COLORSCALE_H
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <math.h>
+#ifdef _WIN32
+#  include <sys/timeb.h>
+#else
+#  include <sys/time.h>
+#endif
+#include "gdal_priv.h"
+#include "stringtok.h"
+
+struct SColor
+{
+  int Red;
+  int Green;
+  int Blue;
+};
+
+struct SColorPoint
+{
+  float Elevation;
+  // Elevation holds a percentage of the band's value range until
+  // ResolvePercentPoints() turns it into an absolute elevation
+  bool IsPercent;
+  SColor Color;
+};
+
+std::vector<SColorPoint*> ColorPointList;
+
+// Set when the lowest (highest) color point is a 0% (100%) entry: cells
+// beyond it get its color rather than the clipping color, as the range
+// the percentages were taken from is only approximate
+bool ClampBelowScale = false;
+bool ClampAboveScale = false;
+
+// Color of the DEM's nodata cells, given by an "nv" entry in the scale file
+SColor NoDataColor = {0,0,0};
+bool HasNoDataColor = false;
+
+//=============================================================================
+// Color channels outside 0 - 255 would wrap around in a Byte band
+//=============================================================================
+inline int ClampChannel(int Value)
+{
+  if (Value < 0)
+    return 0;
+  if (Value > 255)
+    return 255;
+  return Value;
+}
+
+//=============================================================================
+inline void ReadColorScale(const std::string& ScaleFileName)
+{
+  std::ifstream ScaleFile;
+  std::string Buffer;
+  std::list<std::string> StringList;
+  SColorPoint* TempColorPoint;
+
+  ScaleFile.open(ScaleFileName.c_str(), std::ios::in);
+
+  if (!ScaleFile.is_open())
+  {
+    std::cerr << "Error opening color scale file : " << ScaleFileName << std::endl;
+    exit (1);
+  }
+
+  while (!ScaleFile.eof())
+  {
+    StringList.clear();
+    getline(ScaleFile, Buffer);
+
+    // Strip spaces in case we have a blank line
+    while (Buffer[0] == ' ')
+    {
+      Buffer.erase(0);
+    }
+
+    // If not a blank line
+    if (Buffer != "")
+    {
+      TempColorPoint = new SColorPoint;
+      stringtok(StringList, Buffer, " ");
+      std::list<std::string>::iterator i = StringList.begin();
+      std::string Key = *i;
+      TempColorPoint->IsPercent = false;
+      if (Key == "nv" || Key == "NV")
+      {
+        // Nodata entry, kept out of the interpolated color points
+        i++;
+        NoDataColor.Red = ClampChannel(atoi(std::string(*i).c_str()));
+        i++;
+        NoDataColor.Green = ClampChannel(atoi(std::string(*i).c_str()));
+        i++;
+        NoDataColor.Blue = ClampChannel(atoi(std::string(*i).c_str()));
+        HasNoDataColor = true;
+        delete TempColorPoint;
+        continue;
+      }
+      if (Key[Key.size() - 1] == '%')
+      {
+        TempColorPoint->IsPercent = true;
+        Key.erase(Key.size() - 1);
+      }
+      TempColorPoint->Elevation = atof(Key.c_str());
+      i++;
+      TempColorPoint->Color.Red = ClampChannel(atoi(std::string(*i).c_str()));
+      i++;
+      TempColorPoint->Color.Green = ClampChannel(atoi(std::string(*i).c_str()));
+      i++;
+      TempColorPoint->Color.Blue = ClampChannel(atoi(std::string(*i).c_str()));
+
+      ColorPointList.push_back(TempColorPoint);
+    }
+  }
+
+  ScaleFile.close();
+}
+
+//=============================================================================
+// Wall clock time in seconds, to better than a second
+//=============================================================================
+inline double GetWallTime()
+{
+#ifdef _WIN32
+  struct _timeb Now;
+  _ftime(&Now);
+  return Now.time + Now.millitm / 1000.0;
+#else
+  struct timeval Now;
+  gettimeofday(&Now, NULL);
+  return Now.tv_sec + Now.tv_usec / 1000000.0;
+#endif
+}
+
+//=============================================================================
+// Turn percent-of-range color points into elevations. The min/max come from
+// GDAL's approximate statistics, which use an overview or a sample of the
+// blocks instead of an extra full pass over the raster.
+//=============================================================================
+inline void ResolvePercentPoints(GDALRasterBand* poBand)
+{
+  bool HasPercent = false;
+  double Min, Max, Mean, StdDev;
+
+  for (unsigned int i = 0; i < ColorPointList.size(); i++)
+  {
+    if (ColorPointList[i]->IsPercent)
+      HasPercent = true;
+  }
+  if (!HasPercent)
+    return;
+
+  // wall time, so waiting on the reads counts
+  const double StartTime = GetWallTime();
+  if (poBand->GetStatistics(TRUE, TRUE, &Min, &Max, &Mean, &StdDev) != CE_None)
+  {
+    std::cerr << "Couldn't compute statistics for percent color points" << std::endl;
+    exit(1);
+  }
+  std::cerr << "Approximate statistics: min=" << Min << " max=" << Max
+       << " (" << GetWallTime() - StartTime << "s)" << std::endl;
+
+  // Entries at 0% (100%) or beyond, to tell if they end up outermost
+  std::vector<bool> AtMin(ColorPointList.size(), false);
+  std::vector<bool> AtMax(ColorPointList.size(), false);
+  for (unsigned int i = 0; i < ColorPointList.size(); i++)
+  {
+    SColorPoint* TempColorPoint = ColorPointList[i];
+    if (TempColorPoint->IsPercent)
+    {
+      AtMin[i] = TempColorPoint->Elevation <= 0;
+      AtMax[i] = TempColorPoint->Elevation >= 100;
+      TempColorPoint->Elevation = Min + (Max - Min) * TempColorPoint->Elevation / 100.0;
+      TempColorPoint->IsPercent = false;
+    }
+  }
+
+  unsigned int Lowest = 0;
+  unsigned int Highest = 0;
+  for (unsigned int i = 1; i < ColorPointList.size(); i++)
+  {
+    if (ColorPointList[i]->Elevation < ColorPointList[Lowest]->Elevation)
+      Lowest = i;
+    if (ColorPointList[i]->Elevation > ColorPointList[Highest]->Elevation)
+      Highest = i;
+  }
+  ClampBelowScale = AtMin[Lowest];
+  ClampAboveScale = AtMax[Highest];
+}
+
+//=============================================================================
+// Given an elevation calculate a color based on the color points table
+// At the moment we're only doing linear color gradients
+//=============================================================================
+inline SColor GetColor(float Elevation)
+{
+  SColor Color = {0,0,0};
+  SColorPoint* LowerColorPoint = NULL;
+  SColorPoint* UpperColorPoint = NULL;
+  SColorPoint* TempColorPoint;
+  float TempElev;
+  float DiffFactor;
+
+  // Find closest pair of color points that the elevation falls between
+  // Lower color point
+  TempElev = -64000;
+  for (unsigned int i = 0; i < ColorPointList.size(); i++)
+  {
+    TempColorPoint = ColorPointList[i];
+    if ((TempColorPoint->Elevation <= Elevation) && (TempElev < TempColorPoint->Elevation))
+    {
+      TempElev = TempColorPoint->Elevation;
+      LowerColorPoint = TempColorPoint;
+    }
+  }
+  // Upper color point
+  TempElev = 64000;
+  for (unsigned int i = 0; i < ColorPointList.size(); i++)
+  {
+    TempColorPoint = ColorPointList[i];
+    if ((TempColorPoint->Elevation >= Elevation) && (TempElev > TempColorPoint->Elevation))
+    {
+      TempElev = TempColorPoint->Elevation;
+      UpperColorPoint = TempColorPoint;
+    }
+  }
+
+  // Beyond a 0% or 100% entry: the color of that entry
+  if (LowerColorPoint == NULL && ClampBelowScale && UpperColorPoint != NULL)
+    return UpperColorPoint->Color;
+  if (UpperColorPoint == NULL && ClampAboveScale && LowerColorPoint != NULL)
+    return LowerColorPoint->Color;
+
+  // I should change the following clipping logic to use the color scale instead
+  // Return blue
+  if (LowerColorPoint == NULL)
+  {
+    Color.Red = 150;
+    Color.Green = 150;
+    Color.Blue = 255;
+    return Color;
+  }
+
+  // Return white
+  if (UpperColorPoint == NULL)
+  {
+    Color.Red = 255;
+    Color.Green = 255;
+    Color.Blue = 255;
+    return Color;
+  }
+
+  // Work out the factor the elevation is between the lower and upper color point elevations
+  // If the upper and lower color points point to the same color point object then
+  // it means that the elevation falls exactly on a color point
+  if (LowerColorPoint != UpperColorPoint)
+  {
+    DiffFactor = (Elevation - LowerColorPoint->Elevation) / (UpperColorPoint->Elevation - LowerColorPoint->Elevation);
+    Color.Red   = (int)((UpperColorPoint->Color.Red - LowerColorPoint->Color.Red) * DiffFactor) + LowerColorPoint->Color.Red;
+    Color.Green = (int)((UpperColorPoint->Color.Green - LowerColorPoint->Color.Green) * DiffFactor) + LowerColorPoint->Color.Green;
+    Color.Blue  = (int)((UpperColorPoint->Color.Blue - LowerColorPoint->Color.Blue) * DiffFactor) + LowerColorPoint->Color.Blue;
+  }
+  else
+  {
+    Color.Red   = LowerColorPoint->Color.Red;
+    Color.Green = LowerColorPoint->Color.Green;
+    Color.Blue  = LowerColorPoint->Color.Blue;
+  }
+
+  return Color;
+}
+
+//=============================================================================
+// Build a color table and an elevation -> palette index lookup table for an
+// integer DEM. Index 0 is the null cell entry (black) and nodata cells get
+// NoDataIndex: 0 as well, unless the "nv" color isn't black, in which case
+// it has index 1 to itself. With Alpha both entries are transparent.
+// Returns false if the DEM isn't integer or the
+// scale needs more than 256 palette entries, in which case RGB output is
+// used instead.
+//=============================================================================
+inline bool BuildPalette(GDALDataType DataType, GDALColorTable* ColorTable,
+                         std::vector<GByte>& Lut, int& LutMin, GByte& NoDataIndex,
+                         bool Alpha, double MaxLutSize)
+{
+  double TypeMin;
+  double TypeMax;
+  GDALColorEntry Entry;
+  std::map<int, int> ColorIndex;
+
+  switch (DataType)
+  {
+    case GDT_Byte:   TypeMin = 0;           TypeMax = 255;        break;
+    case GDT_UInt16: TypeMin = 0;           TypeMax = 65535;      break;
+    case GDT_Int16:  TypeMin = -32768;      TypeMax = 32767;      break;
+    case GDT_Int32:  TypeMin = -2147483648.0; TypeMax = 2147483647.0; break;
+    default: return false;
+  }
+  if (ColorPointList.empty())
+    return false;
+
+  // Below the lowest and above the highest color point GetColor returns a
+  // constant color (clipping, or the 0%/100% entry's), so the table only has
+  // to span the scale itself
+  double ScaleMin = ColorPointList[0]->Elevation;
+  double ScaleMax = ColorPointList[0]->Elevation;
+  for (unsigned int i = 1; i < ColorPointList.size(); i++)
+  {
+    if (ColorPointList[i]->Elevation < ScaleMin)
+      ScaleMin = ColorPointList[i]->Elevation;
+    if (ColorPointList[i]->Elevation > ScaleMax)
+      ScaleMax = ColorPointList[i]->Elevation;
+  }
+  const double Lo = std::max(TypeMin, floor(ScaleMin) - 1);
+  const double Hi = std::min(TypeMax, ceil(ScaleMax) + 1);
+  if (Hi < Lo || Hi - Lo + 1 > MaxLutSize)
+    return false;
+  // Rows are read as floats, which hold integers exactly up to 2^24
+  if (Lo < -16777216.0 || Hi > 16777216.0)
+    return false;
+
+  Entry.c1 = 0;
+  Entry.c2 = 0;
+  Entry.c3 = 0;
+  Entry.c4 = Alpha ? 0 : 255;
+  ColorTable->SetColorEntry(0, &Entry);
+
+  NoDataIndex = 0;
+  if (HasNoDataColor &&
+      (NoDataColor.Red != 0 || NoDataColor.Green != 0 || NoDataColor.Blue != 0))
+  {
+    NoDataIndex = 1;
+    Entry.c1 = NoDataColor.Red;
+    Entry.c2 = NoDataColor.Green;
+    Entry.c3 = NoDataColor.Blue;
+    ColorTable->SetColorEntry(1, &Entry);
+  }
+  const int FirstIndex = NoDataIndex + 1;
+  Entry.c4 = 255;
+
+  Lut.resize((size_t)(Hi - Lo) + 1);
+  for (size_t n = 0; n < Lut.size(); n++)
+  {
+    SColor Color = GetColor((float)(Lo + n));
+
+    // Black is the null color, as in RGB output
+    if (Color.Red == 0 && Color.Green == 0 && Color.Blue == 0)
+    {
+      Lut[n] = 0;
+      continue;
+    }
+
+    const int Key = (Color.Red << 16) | (Color.Green << 8) | Color.Blue;
+    std::map<int, int>::iterator Found = ColorIndex.find(Key);
+    if (Found == ColorIndex.end())
+    {
+      if ((int)ColorIndex.size() + FirstIndex > 255)
+        return false;
+      const int Index = (int)ColorIndex.size() + FirstIndex;
+      Found = ColorIndex.insert(std::make_pair(Key, Index)).first;
+      Entry.c1 = Color.Red;
+      Entry.c2 = Color.Green;
+      Entry.c3 = Color.Blue;
+      ColorTable->SetColorEntry(Index, &Entry);
+    }
+    Lut[n] = (GByte)Found->second;
+  }
+
+  LutMin = (int)Lo;
+  return true;
+}
+
+//=============================================================================
+// Blend a color channel with a shade value (1 - 255) for composite output
+//=============================================================================
+enum EBlendMode
+{
+  BLEND_MULTIPLY,
+  BLEND_OVERLAY,
+  BLEND_ALPHA
+};
+
+inline int BlendChannel(int Color, float Shade, EBlendMode Mode, float Opacity)
+{
+  float Result;
+
+  switch (Mode)
+  {
+    case BLEND_OVERLAY:
+      if (Color < 128)
+        Result = 2.0 * Color * Shade / 255.0;
+      else
+        Result = 255.0 - 2.0 * (255 - Color) * (255.0 - Shade) / 255.0;
+      break;
+    case BLEND_ALPHA:
+      Result = (1.0 - Opacity) * Color + Opacity * Shade;
+      break;
+    default:
+      Result = Color * Shade / 255.0;
+      break;
+  }
+
+  // Keep blended cells off the null color
+  if (Result < 1.0)
+    return 1;
+  return (int)(Result + 0.5);
+}
+
+#endif /* COLORSCALE_H */
@@ -0,0 +1,568 @@
+/****************************************************************************
+ * demoutput.h
+ * Author: agent
+ * License : 
+ Copyright 2026 agent
+ Licensed under the Apache License, Version 2.0 (the "License"); 
+ you may not use this file except in compliance with the License. 
+ You may obtain a copy of the License at 
+ 
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software 
+ distributed under the License is distributed on an "AS IS" BASIS, 
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+ See the License for the specific language governing permissions and 
+ limitations under the License.
+
+ * output sinks for the tools' rows
+ *
+ * The tools write their output one row at a time, top to bottom, every
+ * band of a row before the next row. That is all a sink can rely on, so
+ * besides a GDAL dataset the rows can go straight to a raw stream (a file
+ * or /vsistdout/, band interleaved by line) or to a callback, without
+ * materializing an intermediate raster on disk. A failed write (full disk, closed pipe)
+ * shows up as WriteRow or Flush returning false.
+ *
+ * Output names:
+ *   -  or /vsistdout/   raw rows on stdout
+ *   -of RAW file        raw rows in file, with an ENVI header in file.hdr
+ *   anything else       a dataset created with the GDAL driver (GTiff)
+ *
+ * Rows can be queued to a writer thread (AsyncOutputSink) so computing
+ * the next rows overlaps with writing and compressing the previous ones.
+ * Compression itself is spread over GDAL's GTiff worker threads
+ * (NUM_THREADS creation option), which compress whole strips/tiles as
+ * they are completed and write them in order.
+ ****************************************************************************/
+
+#ifndef DEMOUTPUT_H
+#define DEMOUTPUT_H
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "gdal_priv.h"
+#include "cpl_multiproc.h"
+#include "cpl_string.h"
+
+// GTiff compresses in threads (NUM_THREADS) from GDAL 2.1 on
+#if GDAL_VERSION_NUM < 2010000
+#  error "demtools needs GDAL 2.1 or later"
+#endif
+
+// Default depth of the writer thread's row queue
+#define OUTPUT_QUEUE_ROWS 64
+
+class OutputSink
+{
+public:
+    OutputSink(int nXSizeIn, int nYSizeIn, int nBandsIn, GDALDataType eTypeIn)
+        : nXSize(nXSizeIn), nYSize(nYSizeIn), nBands(nBandsIn), eType(eTypeIn) {}
+    virtual ~OutputSink() {}
+
+    virtual void SetGeoTransform(double *padfGeoTransform) = 0;
+    virtual void SetProjection(const char *pszProjection) = 0;
+    virtual void SetNoDataValue(double dfNoData) = 0;
+    virtual void SetColorTable(GDALColorTable * /* poColorTable */) {}
+    virtual void SetMetadataItem(const char * /* pszName */, const char * /* pszValue */) {}
+
+    // Write row iRow of band iBand (1 based); pData holds nXSize values of eBufType
+    virtual bool WriteRow(int iBand, int iRow, void *pData, GDALDataType eBufType) = 0;
+
+    // Get every row written so far to disk
+    virtual bool Flush() { return true; }
+
+    // Record statistics of band iBand, once every row is written
+    virtual void SetStatistics(int /* iBand */, double /* dfMin */, double /* dfMax */,
+                               double /* dfMean */, double /* dfStdDev */) {}
+
+    int          GetXSize() const { return nXSize; }
+    int          GetYSize() const { return nYSize; }
+    int          GetBandCount() const { return nBands; }
+    GDALDataType GetDataType() const { return eType; }
+
+protected:
+    int          nXSize;
+    int          nYSize;
+    int          nBands;
+    GDALDataType eType;
+};
+
+/* -----------------------------------------
+ * Rows written to a dataset created by a GDAL driver
+ */
+class GDALOutputSink : public OutputSink
+{
+public:
+    GDALOutputSink(GDALDataset *poDSIn, GDALDataType eTypeIn)
+        : OutputSink(poDSIn->GetRasterXSize(), poDSIn->GetRasterYSize(),
+                     poDSIn->GetRasterCount(), eTypeIn), poDS(poDSIn) {}
+    virtual ~GDALOutputSink() { delete poDS; }
+
+    virtual void SetGeoTransform(double *padfGeoTransform)
+        { poDS->SetGeoTransform(padfGeoTransform); }
+    virtual void SetProjection(const char *pszProjection)
+        { poDS->SetProjection(pszProjection); }
+    virtual void SetNoDataValue(double dfNoData)
+    {
+        for (int iBand = 1; iBand <= nBands; iBand++)
+            poDS->GetRasterBand(iBand)->SetNoDataValue(dfNoData);
+    }
+    virtual void SetColorTable(GDALColorTable *poColorTable)
+    {
+        poDS->GetRasterBand(1)->SetColorInterpretation(GCI_PaletteIndex);
+        poDS->GetRasterBand(1)->SetColorTable(poColorTable);
+    }
+    virtual void SetMetadataItem(const char *pszName, const char *pszValue)
+        { poDS->SetMetadataItem(pszName, pszValue); }
+    virtual bool WriteRow(int iBand, int iRow, void *pData, GDALDataType eBufType)
+    {
+        return poDS->GetRasterBand(iBand)->RasterIO( GF_Write, 0, iRow, nXSize, 1,
+                   pData, nXSize, 1, eBufType, 0, 0 ) == CE_None;
+    }
+    virtual bool Flush()
+    {
+        // FlushCache reports failed writes through the error state only
+        CPLErrorReset();
+        poDS->FlushCache();
+        return CPLGetLastErrorType() != CE_Failure && CPLGetLastErrorType() != CE_Fatal;
+    }
+    virtual void SetStatistics(int iBand, double dfMin, double dfMax,
+                               double dfMean, double dfStdDev)
+    {
+        poDS->GetRasterBand(iBand)->SetStatistics(dfMin, dfMax, dfMean, dfStdDev);
+    }
+
+    GDALDataset *GetDataset() { return poDS; }
+
+private:
+    GDALDataset *poDS;
+};
+
+/* -----------------------------------------
+ * Rows written as raw band interleaved by line data to a file or stream.
+ * For files an ENVI header is written next to the data so GDAL can open it.
+ */
+class RawOutputSink : public OutputSink
+{
+public:
+    RawOutputSink(const char *pszFilename, int nXSizeIn, int nYSizeIn,
+                  int nBandsIn, GDALDataType eTypeIn);
+    virtual ~RawOutputSink();
+
+    bool IsOpen() const { return fp != NULL; }
+
+    virtual void SetGeoTransform(double *padfGeoTransform)
+        { memcpy(adfGeoTransform, padfGeoTransform, sizeof(adfGeoTransform)); hasGeoTransform = true; }
+    virtual void SetProjection(const char *pszProjection)
+        { osProjection = pszProjection ? pszProjection : ""; }
+    virtual void SetNoDataValue(double dfNoDataIn)
+        { dfNoData = dfNoDataIn; hasNoData = true; }
+    virtual bool WriteRow(int iBand, int iRow, void *pData, GDALDataType eBufType);
+    virtual bool Flush()
+        { return fp != NULL && VSIFFlushL(fp) == 0; }
+
+private:
+    void WriteHeader();
+
+    VSILFILE   *fp;
+    std::string osFilename;
+    bool        isStream;
+    int         iNextRow;
+    int         iNextBand;
+    GByte      *pabyRow;
+    double      adfGeoTransform[6];
+    bool        hasGeoTransform;
+    std::string osProjection;
+    double      dfNoData;
+    bool        hasNoData;
+};
+
+inline RawOutputSink::RawOutputSink(const char *pszFilename, int nXSizeIn,
+                                    int nYSizeIn, int nBandsIn,
+                                    GDALDataType eTypeIn)
+    : OutputSink(nXSizeIn, nYSizeIn, nBandsIn, eTypeIn)
+{
+    isStream   = EQUAL(pszFilename, "-") || EQUALN(pszFilename, "/vsistdout/", 11);
+    osFilename = isStream ? "/vsistdout/" : pszFilename;
+    fp         = VSIFOpenL(osFilename.c_str(), "wb");
+    iNextRow   = 0;
+    iNextBand  = 1;
+    pabyRow    = (GByte *) CPLMalloc((GDALGetDataTypeSize(eType) / 8) * nXSize);
+    hasGeoTransform = false;
+    hasNoData  = false;
+    dfNoData   = 0;
+}
+
+inline RawOutputSink::~RawOutputSink()
+{
+    if (fp != NULL) {
+        VSIFCloseL(fp);
+        if (!isStream)
+            WriteHeader();
+    }
+    CPLFree(pabyRow);
+}
+
+inline bool RawOutputSink::WriteRow(int iBand, int iRow, void *pData,
+                                    GDALDataType eBufType)
+{
+    if (fp == NULL)
+        return false;
+
+    // A stream can't seek, so rows have to arrive in order
+    if (iRow != iNextRow || iBand != iNextBand) {
+        fprintf(stderr, "Raw output expects row %d band %d, got row %d band %d\n",
+                iNextRow, iNextBand, iRow, iBand);
+        return false;
+    }
+    if (++iNextBand > nBands) {
+        iNextBand = 1;
+        iNextRow++;
+    }
+
+    // Convert (and clamp) the tool's buffer to the output type
+    const int nWordSize = GDALGetDataTypeSize(eType) / 8;
+    GDALCopyWords(pData, eBufType, GDALGetDataTypeSize(eBufType) / 8,
+                  pabyRow, eType, nWordSize, nXSize);
+    return VSIFWriteL(pabyRow, nWordSize, nXSize, fp) == (size_t) nXSize;
+}
+
+inline void RawOutputSink::WriteHeader()
+{
+    // ENVI data type codes
+    int nEnviType;
+    switch (eType) {
+        case GDT_Byte:    nEnviType = 1;  break;
+        case GDT_Int16:   nEnviType = 2;  break;
+        case GDT_Int32:   nEnviType = 3;  break;
+        case GDT_Float64: nEnviType = 5;  break;
+        case GDT_UInt16:  nEnviType = 12; break;
+        case GDT_UInt32:  nEnviType = 13; break;
+        default:          nEnviType = 4;  break;
+    }
+
+    const std::string osHeader = osFilename + ".hdr";
+    VSILFILE *fpHdr = VSIFOpenL(osHeader.c_str(), "wb");
+    if (fpHdr == NULL)
+        return;
+
+    std::string os = "ENVI\n";
+    os += CPLSPrintf("samples = %d\nlines = %d\nbands = %d\n", nXSize, nYSize, nBands);
+    os += CPLSPrintf("header offset = 0\nfile type = ENVI Standard\ndata type = %d\n", nEnviType);
+    os += CPLSPrintf("interleave = bil\nbyte order = %d\n", CPL_IS_LSB ? 0 : 1);
+    if (hasGeoTransform)
+        os += CPLSPrintf("map info = {Arbitrary, 1, 1, %.15g, %.15g, %.15g, %.15g}\n",
+                         adfGeoTransform[0], adfGeoTransform[3],
+                         adfGeoTransform[1], -adfGeoTransform[5]);
+    if (!osProjection.empty())
+        os += "coordinate system string = {" + osProjection + "}\n";
+    if (hasNoData)
+        os += CPLSPrintf("data ignore value = %.15g\n", dfNoData);
+
+    VSIFWriteL(os.c_str(), 1, os.size(), fpHdr);
+    VSIFCloseL(fpHdr);
+}
+
+/* -----------------------------------------
+ * Rows handed to a function, for library users running the tools' code
+ * in process. Returning false from the function fails the write.
+ */
+typedef bool (*OutputRowFunc)(void *pUserData, int iBand, int iRow,
+                              void *pData, GDALDataType eBufType, int nXSize);
+
+class CallbackOutputSink : public OutputSink
+{
+public:
+    CallbackOutputSink(OutputRowFunc pfnRowIn, void *pUserDataIn, int nXSizeIn,
+                       int nYSizeIn, int nBandsIn, GDALDataType eTypeIn)
+        : OutputSink(nXSizeIn, nYSizeIn, nBandsIn, eTypeIn),
+          pfnRow(pfnRowIn), pUserData(pUserDataIn) {}
+
+    virtual void SetGeoTransform(double * /* padfGeoTransform */) {}
+    virtual void SetProjection(const char * /* pszProjection */) {}
+    virtual void SetNoDataValue(double /* dfNoData */) {}
+    virtual bool WriteRow(int iBand, int iRow, void *pData, GDALDataType eBufType)
+        { return pfnRow(pUserData, iBand, iRow, pData, eBufType, nXSize); }
+
+private:
+    OutputRowFunc pfnRow;
+    void         *pUserData;
+};
+
+/* -----------------------------------------
+ * Rows queued to a writer thread that passes them on to another sink,
+ * so the tool can go on computing while rows are written and compressed
+ */
+class AsyncOutputSink : public OutputSink
+{
+public:
+    AsyncOutputSink(OutputSink *poInner, int nQueueRows);
+    virtual ~AsyncOutputSink();
+
+    // Bytes allocated for the queue
+    static GIntBig GetMemorySize(int nXSize, int nQueueRows)
+        { return (GIntBig) nQueueRows * nXSize * sizeof(double); }
+
+    virtual void SetGeoTransform(double *padfGeoTransform)
+        { poInner->SetGeoTransform(padfGeoTransform); }
+    virtual void SetProjection(const char *pszProjection)
+        { poInner->SetProjection(pszProjection); }
+    virtual void SetNoDataValue(double dfNoData)
+        { poInner->SetNoDataValue(dfNoData); }
+    virtual void SetColorTable(GDALColorTable *poColorTable)
+        { poInner->SetColorTable(poColorTable); }
+    virtual void SetMetadataItem(const char *pszName, const char *pszValue)
+        { poInner->SetMetadataItem(pszName, pszValue); }
+    virtual bool WriteRow(int iBand, int iRow, void *pData, GDALDataType eBufType);
+    virtual bool Flush();
+    virtual void SetStatistics(int iBand, double dfMin, double dfMax,
+                               double dfMean, double dfStdDev);
+
+private:
+    struct QueuedRow
+    {
+        int          iBand;
+        int          iRow;
+        GDALDataType eBufType;
+        GByte       *pabyData;
+    };
+
+    static void WriterThread(void *pArg);
+    bool Drain();
+
+    OutputSink *poInner;
+    QueuedRow  *pasQueue;
+    int         nSlots;
+    int         iHead;
+    int         nCount;
+    bool        bDone;
+    bool        bFailed;
+    void       *hMutex;
+    void       *hCondNotEmpty;
+    void       *hCondNotFull;
+    void       *hThread;
+};
+
+inline AsyncOutputSink::AsyncOutputSink(OutputSink *poInnerIn, int nQueueRows)
+    : OutputSink(poInnerIn->GetXSize(), poInnerIn->GetYSize(),
+                 poInnerIn->GetBandCount(), poInnerIn->GetDataType())
+{
+    poInner  = poInnerIn;
+    nSlots   = (nQueueRows < 2) ? 2 : nQueueRows;
+    pasQueue = (QueuedRow *) CPLMalloc(sizeof(QueuedRow) * nSlots);
+    for (int k = 0; k < nSlots; k++)
+        pasQueue[k].pabyData = (GByte *) CPLMalloc(sizeof(double) * nXSize);
+    iHead    = 0;
+    nCount   = 0;
+    bDone    = false;
+    bFailed  = false;
+
+    hMutex        = CPLCreateMutex();
+    hCondNotEmpty = CPLCreateCond();
+    hCondNotFull  = CPLCreateCond();
+    CPLReleaseMutex(hMutex);
+    hThread       = CPLCreateJoinableThread(WriterThread, this);
+}
+
+inline AsyncOutputSink::~AsyncOutputSink()
+{
+    // Let the writer drain the queue, then close the real output
+    CPLAcquireMutex(hMutex, 1000.0);
+    bDone = true;
+    CPLCondSignal(hCondNotEmpty);
+    CPLReleaseMutex(hMutex);
+    CPLJoinThread(hThread);
+
+    CPLDestroyCond(hCondNotEmpty);
+    CPLDestroyCond(hCondNotFull);
+    CPLDestroyMutex(hMutex);
+    for (int k = 0; k < nSlots; k++)
+        CPLFree(pasQueue[k].pabyData);
+    CPLFree(pasQueue);
+    delete poInner;
+}
+
+inline bool AsyncOutputSink::WriteRow(int iBand, int iRow, void *pData,
+                                      GDALDataType eBufType)
+{
+    CPLAcquireMutex(hMutex, 1000.0);
+    while (nCount == nSlots && !bFailed)
+        CPLCondWait(hCondNotFull, hMutex);
+    if (bFailed) {
+        CPLReleaseMutex(hMutex);
+        return false;
+    }
+
+    QueuedRow *psRow = pasQueue + (iHead + nCount) % nSlots;
+    psRow->iBand    = iBand;
+    psRow->iRow     = iRow;
+    psRow->eBufType = eBufType;
+    memcpy(psRow->pabyData, pData, (GDALGetDataTypeSize(eBufType) / 8) * nXSize);
+    nCount++;
+
+    CPLCondSignal(hCondNotEmpty);
+    CPLReleaseMutex(hMutex);
+    return true;
+}
+
+// Wait for the writer to empty the queue
+inline bool AsyncOutputSink::Drain()
+{
+    CPLAcquireMutex(hMutex, 1000.0);
+    while (nCount > 0 && !bFailed)
+        CPLCondWait(hCondNotFull, hMutex);
+    const bool bOK = !bFailed;
+    CPLReleaseMutex(hMutex);
+    return bOK;
+}
+
+inline bool AsyncOutputSink::Flush()
+{
+    return Drain() && poInner->Flush();
+}
+
+inline void AsyncOutputSink::SetStatistics(int iBand, double dfMin, double dfMax,
+                                           double dfMean, double dfStdDev)
+{
+    Drain();
+    poInner->SetStatistics(iBand, dfMin, dfMax, dfMean, dfStdDev);
+}
+
+inline void AsyncOutputSink::WriterThread(void *pArg)
+{
+    AsyncOutputSink *poThis = (AsyncOutputSink *) pArg;
+
+    CPLAcquireMutex(poThis->hMutex, 1000.0);
+    for (;;) {
+        while (poThis->nCount == 0 && !poThis->bDone)
+            CPLCondWait(poThis->hCondNotEmpty, poThis->hMutex);
+        if (poThis->nCount == 0)
+            break;
+
+        // Write without holding the lock; the slot stays reserved until done
+        QueuedRow *psRow = poThis->pasQueue + poThis->iHead;
+        CPLReleaseMutex(poThis->hMutex);
+        const bool bOK = poThis->poInner->WriteRow(psRow->iBand, psRow->iRow,
+                                                   psRow->pabyData, psRow->eBufType);
+        CPLAcquireMutex(poThis->hMutex, 1000.0);
+
+        if (!bOK)
+            poThis->bFailed = true;
+        poThis->iHead = (poThis->iHead + 1) % poThis->nSlots;
+        poThis->nCount--;
+        CPLCondSignal(poThis->hCondNotFull);
+    }
+    CPLReleaseMutex(poThis->hMutex);
+}
+
+/* -----------------------------------------
+ * Add -co NAME=VALUE to the creation options; a NAME given again replaces
+ * the earlier value (drivers would use the first)
+ */
+inline char **AddCreationOption(char **papszOptions, const char *pszOption)
+{
+    char       *pszKey = NULL;
+    const char *pszValue = CPLParseNameValue(pszOption, &pszKey);
+
+    if (pszKey == NULL || pszValue == NULL) {
+        CPLFree(pszKey);
+        return CSLAddString(papszOptions, pszOption);
+    }
+    papszOptions = CSLSetNameValue(papszOptions, pszKey, pszValue);
+    CPLFree(pszKey);
+    return papszOptions;
+}
+
+/* -----------------------------------------
+ * Defaults added once every -co is parsed: when compression is asked for,
+ * GTiff gets NUM_THREADS=ALL_CPUS unless it was given, so completed
+ * strips/tiles are compressed in parallel.
+ */
+inline char **ApplyCreationDefaults(char **papszOptions, const char *pszFormat)
+{
+    if (EQUAL(pszFormat, "GTiff") &&
+        CSLFetchNameValue(papszOptions, "COMPRESS") != NULL &&
+        CSLFetchNameValue(papszOptions, "NUM_THREADS") == NULL)
+        papszOptions = CSLSetNameValue(papszOptions, "NUM_THREADS", "ALL_CPUS");
+    return papszOptions;
+}
+
+/* -----------------------------------------
+ * Move a geotransform's origin to pixel (nXOff, nYOff), for an output
+ * that covers only part of the input
+ */
+inline void OffsetGeoTransform(double *padfGeoTransform, int nXOff, int nYOff)
+{
+    padfGeoTransform[0] += nXOff * padfGeoTransform[1] + nYOff * padfGeoTransform[2];
+    padfGeoTransform[3] += nXOff * padfGeoTransform[4] + nYOff * padfGeoTransform[5];
+}
+
+/* -----------------------------------------
+ * True if the output name and format make a raw stream or file rather
+ * than a GDAL dataset
+ */
+inline bool IsRawOutput(const char *pszFilename, const char *pszFormat)
+{
+    return EQUAL(pszFilename, "-") || EQUALN(pszFilename, "/vsistdout/", 11) ||
+           EQUAL(pszFormat, "RAW");
+}
+
+/* -----------------------------------------
+ * Create the sink for an output name and format (see top of file).
+ * With nQueueRows > 0 rows are written from a thread through a queue of
+ * that many rows. Returns NULL if the output can't be created.
+ */
+inline OutputSink *CreateOutputSink(const char *pszFilename, const char *pszFormat,
+                                    int nXSize, int nYSize, int nBands,
+                                    GDALDataType eType, char **papszOptions,
+                                    int nQueueRows = 0)
+{
+    OutputSink *poSink;
+
+    if (IsRawOutput(pszFilename, pszFormat))
+    {
+        RawOutputSink *poRawSink = new RawOutputSink(pszFilename, nXSize, nYSize,
+                                                     nBands, eType);
+        if (!poRawSink->IsOpen()) {
+            delete poRawSink;
+            return NULL;
+        }
+        poSink = poRawSink;
+    }
+    else
+    {
+        GDALDriver *poDriver = GetGDALDriverManager()->GetDriverByName(pszFormat);
+        if (poDriver == NULL)
+            return NULL;
+        GDALDataset *poDS = poDriver->Create(pszFilename, nXSize, nYSize, nBands,
+                                             eType, papszOptions);
+        if (poDS == NULL)
+            return NULL;
+        poSink = new GDALOutputSink(poDS, eType);
+    }
+
+    if (nQueueRows > 0)
+        poSink = new AsyncOutputSink(poSink, nQueueRows);
+    return poSink;
+}
+
+/* -----------------------------------------
+ * Reopen an existing GDAL output to write more rows into it (used to
+ * resume an interrupted run). Returns NULL if it can't be opened.
+ */
+inline OutputSink *OpenOutputSink(const char *pszFilename, int nQueueRows = 0)
+{
+    GDALDataset *poDS = (GDALDataset *) GDALOpen(pszFilename, GA_Update);
+    if (poDS == NULL)
+        return NULL;
+
+    OutputSink *poSink = new GDALOutputSink(poDS,
+                             poDS->GetRasterBand(1)->GetRasterDataType());
+    if (nQueueRows > 0)
+        poSink = new AsyncOutputSink(poSink, nQueueRows);
+    return poSink;
+}
+
+#endif /* DEMOUTPUT_H */
@@ -0,0 +1,648 @@
+/****************************************************************************
+ * demshard.cpp
+ * Author: agent
+ * License :
+ Copyright 2026 agent
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ * runs one of the demtools over a DEM in shards and merges the results
+ *
+ * The DEM is split into strips of whole rows (the tools stream rows, so a
+ * strip is read sequentially and only needs extra rows above and below).
+ * Each strip is computed by an independent run of the tool with
+ * -rows first count, which reads the halo rows its kernel needs from the
+ * full DEM and writes a file of its own:
+ *
+ *   slope, aspect           1 row
+ *   hillshade               winDist rows, and with -cs the rows toward the
+ *                           sun that can cast a shadow on the strip (as
+ *                           far as -zrange allows, from the blocks of the
+ *                           shadow sweep around it)
+ *   tpi                     radius rows
+ *   color-relief            none, winDist rows with -hillshade
+ *
+ * The shard outputs are then stitched into a VRT, or copied into a single
+ * GeoTIFF, without recomputing anything. -plan prints the shard commands
+ * to run them on other machines; -merge stitches their outputs afterwards.
+ * With -stats each shard reports on its own strip (name_000.csv, ...) and
+ * the reports are merged into the requested one; a report that doesn't
+ * cover all the rows of its strip is an error.
+ *
+ * The shards are started without a shell, so arguments reach the tool as
+ * they are. Statistics of the DEM a tool would look up in every shard are
+ * resolved once beforehand: approximate statistics (tpi, color-relief
+ * percent points) are computed and saved here, which the shards then read
+ * back instead of all saving them at once, and hillshade -cs is handed the
+ * elevation range as -zrange.
+ ****************************************************************************/
+
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "gdal_priv.h"
+#include "cpl_string.h"
+#include "cpl_multiproc.h"
+#include "cpl_spawn.h"
+#include "rowwindow.h"
+#include "demoutput.h"
+#include "demstats.h"
+#include "gradient.h"
+#include "shadows.h"
+
+struct Shard
+{
+    int         firstRow;
+    int         rowCount;
+    std::string filename;
+    std::string statsFilename;
+    std::vector<std::string> argv;
+    std::string command;
+    int         status;
+};
+
+struct ShardQueue
+{
+    std::vector<Shard> *shards;
+    size_t              next;
+    void               *hMutex;
+};
+
+/* -----------------------------------------
+ * Worker thread: run shard commands until there are none left
+ */
+void RunShards(void *pArg)
+{
+    ShardQueue *psQueue = (ShardQueue *) pArg;
+
+    for (;;) {
+        CPLAcquireMutex(psQueue->hMutex, 1000.0);
+        const size_t iShard = psQueue->next++;
+        CPLReleaseMutex(psQueue->hMutex);
+        if (iShard >= psQueue->shards->size())
+            break;
+
+        Shard &shard = (*psQueue->shards)[iShard];
+        fprintf(stderr, "Shard %d: rows %d to %d\n", (int) iShard,
+                shard.firstRow, shard.firstRow + shard.rowCount - 1);
+
+        std::vector<const char *> argv;
+        for (size_t k = 0; k < shard.argv.size(); k++)
+            argv.push_back(shard.argv[k].c_str());
+        argv.push_back(NULL);
+        CPLSpawnedProcess *psProcess = CPLSpawnAsync(NULL, &argv[0], FALSE, FALSE, FALSE, NULL);
+        shard.status = (psProcess == NULL) ? -1 : CPLSpawnAsyncFinish(psProcess, TRUE, FALSE);
+    }
+}
+
+/* -----------------------------------------
+ * Value of option pszName in the tool arguments, or pszDefault
+ */
+const char *GetToolOption(const std::vector<std::string> &args,
+                          const char *pszName, const char *pszDefault)
+{
+    for (size_t k = 0; k + 1 < args.size(); k++)
+        if (EQUAL(args[k].c_str(), pszName))
+            return args[k+1].c_str();
+    return pszDefault;
+}
+
+bool HasToolOption(const std::vector<std::string> &args, const char *pszName)
+{
+    for (size_t k = 0; k < args.size(); k++)
+        if (EQUAL(args[k].c_str(), pszName))
+            return true;
+    return false;
+}
+
+/* -----------------------------------------
+ * Quote an argument for the shard commands printed by -plan
+ */
+std::string QuoteArgument(const std::string &osArg)
+{
+    if (!osArg.empty() &&
+        osArg.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+                                "0123456789_-+=.,:/@%") == std::string::npos)
+        return osArg;
+
+    std::string osQuoted;
+#ifdef _WIN32
+    osQuoted = "\"";
+    for (size_t k = 0; k < osArg.size(); k++) {
+        if (osArg[k] == '"')
+            osQuoted += '\\';
+        osQuoted += osArg[k];
+    }
+    osQuoted += "\"";
+#else
+    osQuoted = "'";
+    for (size_t k = 0; k < osArg.size(); k++) {
+        if (osArg[k] == '\'')
+            osQuoted += "'\\''";
+        else
+            osQuoted += osArg[k];
+    }
+    osQuoted += "'";
+#endif
+    return osQuoted;
+}
+
+/* -----------------------------------------
+ * Resolve up front the statistics of the DEM each shard would look up,
+ * adding any arguments that pass them on to extraArgs
+ */
+void ResolveSharedStatistics(GDALDataset *poDS, const std::string &osToolName,
+                             const std::vector<std::string> &args,
+                             std::vector<std::string> &extraArgs)
+{
+    float gradScale;
+    if (IsGradientRaster(poDS, &gradScale))
+        return;
+
+    char **papszBands = NULL;
+    for (size_t k = 0; k + 1 < args.size(); k++)
+        if (EQUAL(args[k].c_str(), "-b"))
+            papszBands = CSLAddString(papszBands, args[k+1].c_str());
+    std::vector<int> bands;
+    const bool bBandsOK = SelectBands(poDS->GetRasterCount(), papszBands, bands);
+    CSLDestroy(papszBands);
+    if (!bBandsOK)
+        exit(1);
+
+    bool bApproxStats = false;
+    if (EQUAL(osToolName.c_str(), "tpi"))
+        bApproxStats = true;
+    else if (EQUAL(osToolName.c_str(), "color-relief") && args.size() > 1)
+    {
+        // Percent color points are resolved from the band's range
+        VSILFILE *fp = VSIFOpenL(args[1].c_str(), "rb");
+        char      szBuf[4096];
+        size_t    nRead;
+        while (fp != NULL && !bApproxStats &&
+               (nRead = VSIFReadL(szBuf, 1, sizeof(szBuf), fp)) > 0)
+            bApproxStats = memchr(szBuf, '%', nRead) != NULL;
+        if (fp != NULL)
+            VSIFCloseL(fp);
+    }
+    else if (EQUAL(osToolName.c_str(), "hillshade") &&
+             (HasToolOption(args, "-cs") || HasToolOption(args, "-castshadows")) &&
+             !HasToolOption(args, "-zrange"))
+    {
+        double dfMin;
+        double dfMax;
+        if (GetElevationRange(poDS, bands, &dfMin, &dfMax)) {
+            extraArgs.push_back("-zrange");
+            extraArgs.push_back(CPLSPrintf("%.17g", dfMin));
+            extraArgs.push_back(CPLSPrintf("%.17g", dfMax));
+        }
+    }
+
+    for (size_t k = 0; k < bands.size() && bApproxStats; k++) {
+        double dfMin, dfMax, dfMean, dfStdDev;
+        poDS->GetRasterBand(bands[k])->GetStatistics(TRUE, TRUE, &dfMin, &dfMax,
+                                                     &dfMean, &dfStdDev);
+    }
+}
+
+/* -----------------------------------------
+ * Write a VRT that places each shard at its rows
+ */
+bool WriteShardVRT(const char *pszVRTFilename, GDALDataset *poFirst,
+                   int nXSize, int nYSize, double *padfGeoTransform,
+                   const std::vector<Shard> &shards, const std::vector<DemStats> &stats)
+{
+    VSILFILE *fp = VSIFOpenL(pszVRTFilename, "wb");
+    if (fp == NULL)
+        return false;
+
+    std::string os;
+    os += CPLSPrintf("<VRTDataset rasterXSize=\"%d\" rasterYSize=\"%d\">\n", nXSize, nYSize);
+    char *pszSRS = CPLEscapeString(poFirst->GetProjectionRef(), -1, CPLES_XML);
+    os += CPLSPrintf("  <SRS>%s</SRS>\n", pszSRS);
+    CPLFree(pszSRS);
+    os += CPLSPrintf("  <GeoTransform>%.16g, %.16g, %.16g, %.16g, %.16g, %.16g</GeoTransform>\n",
+                     padfGeoTransform[0], padfGeoTransform[1], padfGeoTransform[2],
+                     padfGeoTransform[3], padfGeoTransform[4], padfGeoTransform[5]);
+
+    for (int iBand = 1; iBand <= poFirst->GetRasterCount(); iBand++) {
+        GDALRasterBand *poBand = poFirst->GetRasterBand(iBand);
+        int hasNoData;
+        const double dfNoData = poBand->GetNoDataValue(&hasNoData);
+
+        os += CPLSPrintf("  <VRTRasterBand dataType=\"%s\" band=\"%d\">\n",
+                         GDALGetDataTypeName(poBand->GetRasterDataType()), iBand);
+        if (hasNoData)
+            os += CPLSPrintf("    <NoDataValue>%.16g</NoDataValue>\n", dfNoData);
+        if ((size_t) iBand <= stats.size() && stats[iBand-1].GetCount() > 0) {
+            const DemStats &bandStats = stats[iBand-1];
+            os += "    <Metadata>\n";
+            os += CPLSPrintf("      <MDI key=\"STATISTICS_MINIMUM\">%.17g</MDI>\n", bandStats.GetMin());
+            os += CPLSPrintf("      <MDI key=\"STATISTICS_MAXIMUM\">%.17g</MDI>\n", bandStats.GetMax());
+            os += CPLSPrintf("      <MDI key=\"STATISTICS_MEAN\">%.17g</MDI>\n", bandStats.GetMean());
+            os += CPLSPrintf("      <MDI key=\"STATISTICS_STDDEV\">%.17g</MDI>\n", bandStats.GetStdDev());
+            os += "    </Metadata>\n";
+        }
+
+        GDALColorTable *poColorTable = poBand->GetColorTable();
+        if (poColorTable != NULL) {
+            os += "    <ColorInterp>Palette</ColorInterp>\n    <ColorTable>\n";
+            for (int k = 0; k < poColorTable->GetColorEntryCount(); k++) {
+                const GDALColorEntry *psEntry = poColorTable->GetColorEntry(k);
+                os += CPLSPrintf("      <Entry c1=\"%d\" c2=\"%d\" c3=\"%d\" c4=\"%d\"/>\n",
+                                 psEntry->c1, psEntry->c2, psEntry->c3, psEntry->c4);
+            }
+            os += "    </ColorTable>\n";
+        }
+
+        for (size_t k = 0; k < shards.size(); k++) {
+            os += "    <SimpleSource>\n";
+            os += CPLSPrintf("      <SourceFilename relativeToVRT=\"1\">%s</SourceFilename>\n",
+                             CPLGetFilename(shards[k].filename.c_str()));
+            os += CPLSPrintf("      <SourceBand>%d</SourceBand>\n", iBand);
+            os += CPLSPrintf("      <SrcRect xOff=\"0\" yOff=\"0\" xSize=\"%d\" ySize=\"%d\"/>\n",
+                             nXSize, shards[k].rowCount);
+            os += CPLSPrintf("      <DstRect xOff=\"0\" yOff=\"%d\" xSize=\"%d\" ySize=\"%d\"/>\n",
+                             shards[k].firstRow, nXSize, shards[k].rowCount);
+            os += "    </SimpleSource>\n";
+        }
+        os += "  </VRTRasterBand>\n";
+    }
+    os += "</VRTDataset>\n";
+
+    const bool bOK = VSIFWriteL(os.c_str(), 1, os.size(), fp) == os.size();
+    VSIFCloseL(fp);
+    return bOK;
+}
+
+/* -----------------------------------------
+ * Copy the shards' rows into one output
+ */
+bool CopyShards(const char *pszFilename, GDALDataset *poFirst,
+                int nXSize, int nYSize, double *padfGeoTransform,
+                const std::vector<Shard> &shards, const std::vector<DemStats> &stats,
+                char **papszOptions)
+{
+    const int          nBands = poFirst->GetRasterCount();
+    GDALRasterBand    *poFirstBand = poFirst->GetRasterBand(1);
+    const GDALDataType eType = poFirstBand->GetRasterDataType();
+
+    OutputSink *poOut = CreateOutputSink(pszFilename, "GTiff", nXSize, nYSize, nBands,
+                                         eType, papszOptions, OUTPUT_QUEUE_ROWS);
+    if (poOut == NULL)
+        return false;
+    poOut->SetGeoTransform(padfGeoTransform);
+    poOut->SetProjection(poFirst->GetProjectionRef());
+    int hasNoData;
+    const double dfNoData = poFirstBand->GetNoDataValue(&hasNoData);
+    if (hasNoData)
+        poOut->SetNoDataValue(dfNoData);
+    if (poFirstBand->GetColorTable() != NULL)
+        poOut->SetColorTable(poFirstBand->GetColorTable());
+
+    double *row = (double *) CPLMalloc(sizeof(double)*nXSize);
+    bool    bOK = true;
+
+    for (size_t k = 0; k < shards.size() && bOK; k++) {
+        GDALDataset *poShard = (GDALDataset *) GDALOpen(shards[k].filename.c_str(), GA_ReadOnly);
+        if (poShard == NULL) {
+            bOK = false;
+            break;
+        }
+        for (int i = 0; i < shards[k].rowCount && bOK; i++) {
+            for (int iBand = 1; iBand <= nBands && bOK; iBand++) {
+                bOK = poShard->GetRasterBand(iBand)->RasterIO( GF_Read, 0, i, nXSize, 1,
+                          row, nXSize, 1, GDT_Float64, 0, 0 ) == CE_None &&
+                      poOut->WriteRow(iBand, shards[k].firstRow + i, row, GDT_Float64);
+            }
+        }
+        GDALClose(poShard);
+    }
+    for (size_t b = 0; b < stats.size() && bOK; b++) {
+        if (stats[b].GetCount() > 0)
+            poOut->SetStatistics((int) b + 1, stats[b].GetMin(), stats[b].GetMax(),
+                                 stats[b].GetMean(), stats[b].GetStdDev());
+    }
+
+    CPLFree(row);
+    bOK = poOut->Flush() && bOK;
+    delete poOut;
+    return bOK;
+}
+
+int main(int nArgc, char ** papszArgv)
+{
+    /* -----------------------------------
+     * Defaults
+     */
+    int         nShards = 0;
+    int         nJobs = 0;
+    int         planOnly = 0;
+    int         mergeOnly = 0;
+    int         iArg;
+
+    /* -----------------------------------
+     * Parse Input Arguments
+     */
+    for ( iArg = 1; iArg < nArgc && papszArgv[iArg][0] == '-'; iArg++ )
+    {
+        if( EQUAL(papszArgv[iArg],"-n") && iArg + 1 < nArgc )
+            nShards = atoi(papszArgv[++iArg]);
+        else if( EQUAL(papszArgv[iArg],"-j") && iArg + 1 < nArgc )
+            nJobs = atoi(papszArgv[++iArg]);
+        else if( EQUAL(papszArgv[iArg],"-plan") )
+            planOnly = 1;
+        else if( EQUAL(papszArgv[iArg],"-merge") )
+            mergeOnly = 1;
+    }
+
+    if (nArgc - iArg < 3)
+    {
+        printf( " \n Runs a demtools command over a DEM in shards of rows and merges them\n"
+                " Usage: \n"
+                "   demshard [-n shards (default=number of CPUs)] [-j parallel jobs (default=number of CPUs)]\n"
+                "            [-plan] [-merge] tool tool_arguments...\n\n"
+                " Notes : \n"
+                "   The tool arguments are the usual ones; the output named there becomes\n"
+                "   the merged result, a VRT if it ends in .vrt and a GeoTIFF otherwise.\n"
+                "   The shards are written next to it as name_000.tif, name_001.tif, ...\n"
+                "   -plan prints the shard commands (to run them elsewhere) without running\n"
+                "   them; -merge only stitches the outputs of shards that have been run.\n"
+                "   Example : demshard -n 16 -j 4 hillshade big.dem shade.vrt -wd 2\n\n");
+        exit(1);
+    }
+
+    const char *pszTool = papszArgv[iArg];
+    std::vector<std::string> args;
+    for ( int k = iArg + 1; k < nArgc; k++ )
+        args.push_back(papszArgv[k]);
+
+    /* -----------------------------------------
+     * Rows of halo each shard reads around its strip
+     */
+    std::string osToolName = CPLGetBasename(pszTool);
+    size_t      iOutputArg = 1;
+    int         halo;
+
+    if (EQUAL(osToolName.c_str(), "slope") || EQUAL(osToolName.c_str(), "aspect"))
+        halo = 1;
+    else if (EQUAL(osToolName.c_str(), "hillshade"))
+        halo = atoi(GetToolOption(args, "-wd", GetToolOption(args, "-windist", "1")));
+    else if (EQUAL(osToolName.c_str(), "tpi"))
+        halo = atoi(GetToolOption(args, "-r", GetToolOption(args, "-radius", "1")));
+    else if (EQUAL(osToolName.c_str(), "color-relief"))
+    {
+        iOutputArg = 2;
+        halo = HasToolOption(args, "-hillshade") ?
+               atoi(GetToolOption(args, "-wd", GetToolOption(args, "-windist", "1"))) : 0;
+    }
+    else
+    {
+        fprintf( stderr, "Don't know how to shard %s\n", pszTool );
+        exit(1);
+    }
+
+    if (args.size() <= iOutputArg)
+    {
+        fprintf( stderr, "Missing arguments for %s\n", pszTool );
+        exit(1);
+    }
+    const char  *pszFilename = args[0].c_str();
+    const std::string osOutput = args[iOutputArg];
+    if (IsRawOutput(osOutput.c_str(), "GTiff"))
+    {
+        fprintf( stderr, "Shards can't be merged into a stream\n" );
+        exit(1);
+    }
+    const bool  bRawShards = EQUAL(GetToolOption(args, "-of", "GTiff"), "RAW");
+    const char *pszStatsFilename = GetToolOption(args, "-stats", NULL);
+
+    GDALAllRegister();
+
+    /*---------------------------------------
+     * Open Dataset to plan the shards
+     */
+    GDALDataset *poDataset = (GDALDataset *) GDALOpen( pszFilename, GA_ReadOnly );
+    if( poDataset == NULL )
+    {
+        fprintf( stderr, "Couldn't open dataset %s\n",
+                 pszFilename );
+        exit(1);
+    }
+    const int   nXSize = poDataset->GetRasterXSize();
+    const int   nYSize = poDataset->GetRasterYSize();
+    double      adfGeoTransform[6];
+    int         nBlockXSize;
+    int         nBlockYSize;
+    poDataset->GetGeoTransform( adfGeoTransform );
+    poDataset->GetRasterBand(1)->GetBlockSize( &nBlockXSize, &nBlockYSize );
+    std::vector<std::string> extraArgs;
+    if (!mergeOnly)
+        ResolveSharedStatistics(poDataset, osToolName, args, extraArgs);
+    GDALClose( poDataset );
+
+    if (nShards < 1)
+        nShards = CPLGetNumCPUs();
+    if (nJobs < 1)
+        nJobs = CPLGetNumCPUs();
+
+    // Start the strips on input block rows so no block is read by two
+    // shards (other than for the halos)
+    int rowsPerShard = (nYSize + nShards - 1) / nShards;
+    if (nBlockYSize > 1 && rowsPerShard > nBlockYSize)
+        rowsPerShard = (rowsPerShard + nBlockYSize - 1) / nBlockYSize * nBlockYSize;
+
+    const std::string osPath = CPLGetPath(osOutput.c_str());
+    const std::string osBase = CPLGetBasename(osOutput.c_str());
+    std::vector<Shard> shards;
+
+    for ( int firstRow = 0; firstRow < nYSize; firstRow += rowsPerShard )
+    {
+        Shard shard;
+        shard.firstRow = firstRow;
+        shard.rowCount = (firstRow + rowsPerShard > nYSize) ? nYSize - firstRow : rowsPerShard;
+        shard.filename = CPLFormFilename(osPath.c_str(),
+                                         CPLSPrintf("%s_%03d", osBase.c_str(), (int) shards.size()),
+                                         bRawShards ? "bil" : "tif");
+        shard.statsFilename = CPLResetExtension(shard.filename.c_str(), "csv");
+        shard.status   = 0;
+
+        shard.argv.push_back(pszTool);
+        for ( size_t k = 0; k < args.size(); k++ )
+        {
+            if (k == iOutputArg)
+                shard.argv.push_back(shard.filename);
+            else if (k > 0 && EQUAL(args[k-1].c_str(), "-stats"))
+                shard.argv.push_back(shard.statsFilename);
+            else
+                shard.argv.push_back(args[k]);
+        }
+        shard.argv.insert(shard.argv.end(), extraArgs.begin(), extraArgs.end());
+        shard.argv.push_back("-rows");
+        shard.argv.push_back(CPLSPrintf("%d", shard.firstRow));
+        shard.argv.push_back(CPLSPrintf("%d", shard.rowCount));
+
+        for ( size_t k = 0; k < shard.argv.size(); k++ )
+            shard.command += (k > 0 ? " " : "") + QuoteArgument(shard.argv[k]);
+
+        shards.push_back(shard);
+    }
+
+    if (planOnly)
+    {
+        // Hillshade -cs sweeps shadows from rows toward the sun, as far as
+        // the elevation range (-zrange, given or resolved above) reaches
+        ShadowSweep *poShadows = NULL;
+        if (EQUAL(osToolName.c_str(), "hillshade") &&
+            (HasToolOption(args, "-cs") || HasToolOption(args, "-castshadows")))
+        {
+            std::vector<std::string> toolArgs(args);
+            toolArgs.insert(toolArgs.end(), extraArgs.begin(), extraArgs.end());
+            double zRange = 0;
+            for (size_t k = 0; k + 2 < toolArgs.size(); k++)
+                if (EQUAL(toolArgs[k].c_str(), "-zrange"))
+                    zRange = atof(toolArgs[k+2].c_str()) - atof(toolArgs[k+1].c_str());
+            const float scale = (float) atof(GetToolOption(toolArgs, "-s",
+                                             GetToolOption(toolArgs, "-scale", "1")));
+            const float az = (float) atof(GetToolOption(toolArgs, "-az",
+                                          GetToolOption(toolArgs, "-azimuth", "315")));
+            const float alt = (float) atof(GetToolOption(toolArgs, "-alt",
+                                           GetToolOption(toolArgs, "-altitude", "45")));
+            poShadows = new ShadowSweep(1, nYSize, 1, adfGeoTransform[1], adfGeoTransform[5],
+                                        scale, (float) atof(GetToolOption(toolArgs, "-z", "1")),
+                                        az, alt, zRange);
+        }
+
+        for ( size_t k = 0; k < shards.size(); k++ )
+        {
+            const int lastRow = shards[k].firstRow + shards[k].rowCount - 1;
+            int readFirst = (shards[k].firstRow - halo < 0) ? 0 : shards[k].firstRow - halo;
+            int readLast  = (lastRow + halo > nYSize - 1) ? nYSize - 1 : lastRow + halo;
+            if (poShadows != NULL)
+            {
+                int shadowFirst;
+                int shadowLast;
+                poShadows->GetInputRows(shards[k].firstRow, lastRow, &shadowFirst, &shadowLast);
+                readFirst = (shadowFirst < readFirst) ? shadowFirst : readFirst;
+                readLast  = (shadowLast > readLast) ? shadowLast : readLast;
+            }
+            printf( "# shard %d: output rows %d to %d, input rows %d to %d\n", (int) k,
+                    shards[k].firstRow, shards[k].firstRow + shards[k].rowCount - 1,
+                    readFirst, readLast );
+            printf( "%s\n", shards[k].command.c_str() );
+        }
+        delete poShadows;
+        return 0;
+    }
+
+    /* -----------------------------------------
+     * Run the shards, nJobs at a time
+     */
+    if (!mergeOnly)
+    {
+        ShardQueue sQueue;
+        sQueue.shards = &shards;
+        sQueue.next   = 0;
+        sQueue.hMutex = CPLCreateMutex();
+        CPLReleaseMutex(sQueue.hMutex);
+
+        std::vector<void *> threads;
+        for ( int k = 0; k < nJobs && k < (int) shards.size(); k++ )
+            threads.push_back(CPLCreateJoinableThread(RunShards, &sQueue));
+        for ( size_t k = 0; k < threads.size(); k++ )
+            CPLJoinThread(threads[k]);
+        CPLDestroyMutex(sQueue.hMutex);
+
+        for ( size_t k = 0; k < shards.size(); k++ )
+        {
+            if (shards[k].status != 0)
+            {
+                fprintf( stderr, "Shard %d failed: %s\n", (int) k, shards[k].command.c_str() );
+                exit(1);
+            }
+        }
+    }
+
+    /* -----------------------------------------
+     * Stitch the shards together
+     */
+    GDALDataset *poFirst = (GDALDataset *) GDALOpen( shards[0].filename.c_str(), GA_ReadOnly );
+    if( poFirst == NULL )
+    {
+        fprintf( stderr, "Couldn't open shard %s\n", shards[0].filename.c_str() );
+        exit(1);
+    }
+
+    // Statistics of each output band, merged from the shard reports
+    std::vector<DemStats> stats;
+    if (pszStatsFilename != NULL)
+    {
+        std::vector<int> bands;
+        for ( size_t k = 0; k < shards.size(); k++ )
+        {
+            std::vector<DemStats> shardStats;
+            std::vector<int>      shardBands;
+            if (!ReadStatsReport(shards[k].statsFilename.c_str(), shardStats, shardBands) ||
+                (int) shardStats.size() != poFirst->GetRasterCount())
+            {
+                fprintf( stderr, "Couldn't read %s\n", shards[k].statsFilename.c_str() );
+                exit(1);
+            }
+            for ( size_t b = 0; b < shardStats.size(); b++ )
+            {
+                // A report on part of its strip would leave rows out of
+                // the merged statistics
+                if (shardStats[b].GetRows() != shards[k].rowCount)
+                {
+                    fprintf( stderr, "%s covers %.0f of the %d rows of its shard\n",
+                             shards[k].statsFilename.c_str(),
+                             (double) shardStats[b].GetRows(), shards[k].rowCount );
+                    exit(1);
+                }
+                if (k > 0)
+                    stats[b].Merge(shardStats[b]);
+            }
+            if (k == 0)
+            {
+                stats = shardStats;
+                bands = shardBands;
+            }
+        }
+        if (!WriteStatsReport(pszStatsFilename, stats, bands))
+            fprintf( stderr, "Couldn't write %s\n", pszStatsFilename );
+    }
+
+    bool bOK;
+    if (EQUAL(CPLGetExtension(osOutput.c_str()), "vrt"))
+        bOK = WriteShardVRT(osOutput.c_str(), poFirst, nXSize, nYSize,
+                            adfGeoTransform, shards, stats);
+    else
+    {
+        char **papszOptions = NULL;
+        for ( size_t k = 0; k + 1 < args.size(); k++ )
+            if (EQUAL(args[k].c_str(), "-co"))
+                papszOptions = AddCreationOption(papszOptions, args[k+1].c_str());
+        papszOptions = ApplyCreationDefaults(papszOptions, "GTiff");
+        bOK = CopyShards(osOutput.c_str(), poFirst, nXSize, nYSize,
+                         adfGeoTransform, shards, stats, papszOptions);
+        CSLDestroy(papszOptions);
+    }
+    GDALClose( poFirst );
+
+    if (!bOK)
+    {
+        fprintf( stderr, "Couldn't merge the shards into %s\n", osOutput.c_str() );
+        exit(1);
+    }
+
+    return 0;
+}
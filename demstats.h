@@ -0,0 +1,433 @@
+/****************************************************************************
+ * demstats.h
+ * Author: agent
+ * License :
+ Copyright 2026 agent
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ * statistics of a tool's output accumulated while it is computed (-stats)
+ *
+ * Min, max, mean and standard deviation are exact (running mean and sum
+ * of squared deviations, Welford's method) and a histogram is kept over
+ * either classes given by their edges (slope classes) or sectors centred
+ * on north (aspect rose). Accumulators of separate parts of a raster,
+ * such as demshard's shards, merge into those of the whole (Chan et al.).
+ * The rows of the raster they cover are counted too, so a report on part
+ * of a strip can be told from one on all of it.
+ *
+ * Reports are written as JSON if the file name ends in .json, else CSV:
+ *
+ *   statistic,value          class,from,to,count
+ *   rows,n                   0-5,0,5,n
+ *   count,n                  ...
+ *   min,v ...
+ *
+ * A report on several bands has a section for each: in CSV each starts
+ * with a band,n line, in JSON they make up a "bands" array.
+ ****************************************************************************/
+
+#ifndef DEMSTATS_H
+#define DEMSTATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include "gdal_priv.h"
+#include "cpl_string.h"
+
+class DemStats
+{
+public:
+    DemStats() : rows(0), count(0), min(0), max(0), mean(0), m2(0), nRose(0) {}
+
+    // Histogram classes from a list of edges such as "0,5,10,30": class k
+    // holds values from edge k up to edge k+1 (values below the first edge
+    // go in the first class), the last class is open ended
+    void SetClasses(const char *pszEdges);
+
+    // Histogram of nDirections sectors of the compass, the first centred
+    // on north
+    void SetRose(int nDirections);
+
+    void Add(double v);
+    void Merge(const DemStats &other);
+
+    // Count nRows more rows of the raster as covered
+    void AddRows(int nRows) { rows += nRows; }
+
+    GIntBig GetRows() const { return rows; }
+    GIntBig GetCount() const { return count; }
+    double  GetMin() const { return min; }
+    double  GetMax() const { return max; }
+    double  GetMean() const { return mean; }
+    double  GetStdDev() const { return count > 0 ? sqrt(m2 / count) : 0; }
+
+    bool WriteReport(const char *pszFilename) const;
+
+    // Read back a CSV report (to merge reports of separate runs)
+    bool ReadReport(const char *pszFilename);
+
+    // Report text, JSON fields indented by pszIndent or CSV, and back
+    std::string FormatReport(bool bJSON, const char *pszIndent) const;
+    void        ParseReport(char **papszLines);
+    static bool SaveReport(const char *pszFilename, const std::string &os);
+
+    // Everything accumulated so far as one line of text, to carry it over
+    // to a resumed run (SetState needs the same classes or rose)
+    std::string GetState() const;
+    bool        SetState(const char *pszState);
+
+private:
+    struct Class
+    {
+        std::string label;
+        double      from;
+        double      to;
+    };
+
+    int  GetClass(double v) const;
+
+    GIntBig              rows;
+    GIntBig              count;
+    double               min;
+    double               max;
+    double               mean;
+    double               m2;
+    std::vector<double>  edges;
+    int                  nRose;
+    std::vector<Class>   classes;
+    std::vector<GIntBig> counts;
+};
+
+inline void DemStats::SetClasses(const char *pszEdges)
+{
+    char **papszEdges = CSLTokenizeString2(pszEdges, ",", 0);
+
+    edges.clear();
+    classes.clear();
+    for (int k = 0; papszEdges != NULL && papszEdges[k] != NULL; k++)
+        edges.push_back(atof(papszEdges[k]));
+    CSLDestroy(papszEdges);
+
+    for (size_t k = 0; k < edges.size(); k++) {
+        Class c;
+        c.from = edges[k];
+        if (k + 1 < edges.size()) {
+            c.to    = edges[k+1];
+            c.label = CPLSPrintf("%g-%g", c.from, c.to);
+        } else {
+            c.to    = HUGE_VAL;
+            c.label = CPLSPrintf("%g+", c.from);
+        }
+        classes.push_back(c);
+    }
+    nRose = 0;
+    counts.assign(classes.size(), 0);
+}
+
+inline void DemStats::SetRose(int nDirections)
+{
+    static const char *apszNames8[] = { "N", "NE", "E", "SE", "S", "SW", "W", "NW" };
+    static const char *apszNames16[] = { "N", "NNE", "NE", "ENE", "E", "ESE", "SE", "SSE",
+                                         "S", "SSW", "SW", "WSW", "W", "WNW", "NW", "NNW" };
+    const double width = 360.0 / nDirections;
+
+    edges.clear();
+    classes.clear();
+    for (int k = 0; k < nDirections; k++) {
+        Class c;
+        c.from = fmod(k * width - width / 2 + 360.0, 360.0);
+        c.to   = fmod(k * width + width / 2, 360.0);
+        if (nDirections == 4)
+            c.label = apszNames8[2 * k];
+        else if (nDirections == 8)
+            c.label = apszNames8[k];
+        else if (nDirections == 16)
+            c.label = apszNames16[k];
+        else
+            c.label = CPLSPrintf("%g", k * width);
+        classes.push_back(c);
+    }
+    nRose = nDirections;
+    counts.assign(classes.size(), 0);
+}
+
+inline int DemStats::GetClass(double v) const
+{
+    if (nRose > 0)
+        return (int) floor(v * nRose / 360.0 + 0.5) % nRose;
+
+    // Last edge at or below v
+    int lo = 0;
+    int hi = (int) edges.size() - 1;
+    while (lo < hi) {
+        const int mid = (lo + hi + 1) / 2;
+        if (edges[mid] <= v)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+inline void DemStats::Add(double v)
+{
+    count++;
+    if (count == 1)
+        min = max = v;
+    else if (v < min)
+        min = v;
+    else if (v > max)
+        max = v;
+
+    const double delta = v - mean;
+    mean += delta / count;
+    m2   += delta * (v - mean);
+
+    if (!counts.empty())
+        counts[GetClass(v)]++;
+}
+
+inline void DemStats::Merge(const DemStats &other)
+{
+    rows += other.rows;
+    if (other.count == 0)
+        return;
+    if (count == 0) {
+        const GIntBig nRows = rows;
+        *this = other;
+        rows = nRows;
+        return;
+    }
+
+    const double n     = (double) count + other.count;
+    const double delta = other.mean - mean;
+    mean += delta * other.count / n;
+    m2   += other.m2 + delta * delta * ((double) count * other.count / n);
+    count += other.count;
+    if (other.min < min)
+        min = other.min;
+    if (other.max > max)
+        max = other.max;
+
+    for (size_t k = 0; k < counts.size() && k < other.counts.size(); k++)
+        counts[k] += other.counts[k];
+}
+
+inline std::string DemStats::FormatReport(bool bJSON, const char *pszIndent) const
+{
+    std::string os;
+
+    if (bJSON) {
+        os += CPLSPrintf("%s\"rows\": %.0f,\n", pszIndent, (double) rows);
+        os += CPLSPrintf("%s\"count\": %.0f,\n", pszIndent, (double) count);
+        os += CPLSPrintf("%s\"min\": %.17g,\n%s\"max\": %.17g,\n", pszIndent, min, pszIndent, max);
+        os += CPLSPrintf("%s\"mean\": %.17g,\n%s\"stddev\": %.17g,\n",
+                         pszIndent, mean, pszIndent, GetStdDev());
+        os += CPLSPrintf("%s\"histogram\": [", pszIndent);
+        for (size_t k = 0; k < classes.size(); k++) {
+            os += (k == 0) ? "\n" : ",\n";
+            os += CPLSPrintf("%s  { \"class\": \"%s\", \"from\": %.17g, ",
+                             pszIndent, classes[k].label.c_str(), classes[k].from);
+            if (classes[k].to == HUGE_VAL)
+                os += "\"to\": null, ";
+            else
+                os += CPLSPrintf("\"to\": %.17g, ", classes[k].to);
+            os += CPLSPrintf("\"count\": %.0f }", (double) counts[k]);
+        }
+        os += CPLSPrintf("\n%s]\n", pszIndent);
+    } else {
+        os += "statistic,value\n";
+        os += CPLSPrintf("rows,%.0f\n", (double) rows);
+        os += CPLSPrintf("count,%.0f\n", (double) count);
+        os += CPLSPrintf("min,%.17g\nmax,%.17g\n", min, max);
+        os += CPLSPrintf("mean,%.17g\nstddev,%.17g\n", mean, GetStdDev());
+        os += "class,from,to,count\n";
+        for (size_t k = 0; k < classes.size(); k++) {
+            os += CPLSPrintf("%s,%.17g,", classes[k].label.c_str(), classes[k].from);
+            if (classes[k].to != HUGE_VAL)
+                os += CPLSPrintf("%.17g", classes[k].to);
+            os += CPLSPrintf(",%.0f\n", (double) counts[k]);
+        }
+    }
+    return os;
+}
+
+inline bool DemStats::WriteReport(const char *pszFilename) const
+{
+    const bool bJSON = EQUAL(CPLGetExtension(pszFilename), "json");
+
+    if (bJSON)
+        return SaveReport(pszFilename, "{\n" + FormatReport(true, "  ") + "}\n");
+    return SaveReport(pszFilename, FormatReport(false, ""));
+}
+
+inline bool DemStats::SaveReport(const char *pszFilename, const std::string &os)
+{
+    VSILFILE *fp = VSIFOpenL(pszFilename, "wb");
+    if (fp == NULL)
+        return false;
+    const bool bOK = VSIFWriteL(os.c_str(), 1, os.size(), fp) == os.size();
+    VSIFCloseL(fp);
+    return bOK;
+}
+
+inline void DemStats::ParseReport(char **papszLines)
+{
+    double stdDev = 0;
+    bool   inClasses = false;
+
+    rows  = 0;
+    count = 0;
+    edges.clear();
+    classes.clear();
+    counts.clear();
+    for (int k = 0; papszLines != NULL && papszLines[k] != NULL; k++) {
+        char **papszFields = CSLTokenizeString2(papszLines[k], ",", CSLT_ALLOWEMPTYTOKENS);
+        const int nFields = CSLCount(papszFields);
+
+        if (nFields == 4 && EQUAL(papszFields[0], "class"))
+            inClasses = true;
+        else if (inClasses && nFields == 4) {
+            Class c;
+            c.label = papszFields[0];
+            c.from  = atof(papszFields[1]);
+            c.to    = (papszFields[2][0] == '\0') ? HUGE_VAL : atof(papszFields[2]);
+            classes.push_back(c);
+            counts.push_back((GIntBig) atof(papszFields[3]));
+        }
+        else if (nFields == 2) {
+            if (EQUAL(papszFields[0], "rows"))
+                rows = (GIntBig) atof(papszFields[1]);
+            else if (EQUAL(papszFields[0], "count"))
+                count = (GIntBig) atof(papszFields[1]);
+            else if (EQUAL(papszFields[0], "min"))
+                min = atof(papszFields[1]);
+            else if (EQUAL(papszFields[0], "max"))
+                max = atof(papszFields[1]);
+            else if (EQUAL(papszFields[0], "mean"))
+                mean = atof(papszFields[1]);
+            else if (EQUAL(papszFields[0], "stddev"))
+                stdDev = atof(papszFields[1]);
+        }
+        CSLDestroy(papszFields);
+    }
+
+    m2 = stdDev * stdDev * count;
+}
+
+inline bool DemStats::ReadReport(const char *pszFilename)
+{
+    char **papszLines = CSLLoad(pszFilename);
+    if (papszLines == NULL)
+        return false;
+
+    ParseReport(papszLines);
+    CSLDestroy(papszLines);
+    return true;
+}
+
+// Report on the bands given (as numbered in the input), in sections
+// unless there is only one
+inline bool WriteStatsReport(const char *pszFilename, const std::vector<DemStats> &stats,
+                             const std::vector<int> &bands)
+{
+    if (stats.size() == 1)
+        return stats[0].WriteReport(pszFilename);
+
+    const bool bJSON = EQUAL(CPLGetExtension(pszFilename), "json");
+    std::string os;
+
+    if (bJSON) {
+        os += "{\n  \"bands\": [";
+        for (size_t b = 0; b < stats.size(); b++) {
+            os += (b == 0) ? "\n" : ",\n";
+            os += CPLSPrintf("    {\n      \"band\": %d,\n", bands[b]);
+            os += stats[b].FormatReport(true, "      ");
+            os += "    }";
+        }
+        os += "\n  ]\n}\n";
+    } else {
+        for (size_t b = 0; b < stats.size(); b++) {
+            os += CPLSPrintf("band,%d\n", bands[b]);
+            os += stats[b].FormatReport(false, "");
+        }
+    }
+    return DemStats::SaveReport(pszFilename, os);
+}
+
+// Read back a CSV report on one or more bands
+inline bool ReadStatsReport(const char *pszFilename, std::vector<DemStats> &stats,
+                            std::vector<int> &bands)
+{
+    char **papszLines = CSLLoad(pszFilename);
+    if (papszLines == NULL)
+        return false;
+
+    // Split the lines into a section per band; a report without band
+    // lines is a single section (of band 1)
+    std::vector<char **> sections;
+    bands.clear();
+    for (int k = 0; papszLines[k] != NULL; k++) {
+        if (EQUALN(papszLines[k], "band,", 5)) {
+            bands.push_back(atoi(papszLines[k] + 5));
+            sections.push_back(NULL);
+        } else {
+            if (sections.empty()) {
+                bands.push_back(1);
+                sections.push_back(NULL);
+            }
+            sections.back() = CSLAddString(sections.back(), papszLines[k]);
+        }
+    }
+    CSLDestroy(papszLines);
+
+    stats.assign(sections.size(), DemStats());
+    for (size_t b = 0; b < sections.size(); b++) {
+        stats[b].ParseReport(sections[b]);
+        CSLDestroy(sections[b]);
+    }
+    return true;
+}
+
+inline std::string DemStats::GetState() const
+{
+    std::string os = CPLSPrintf("%.0f %.0f %.17g %.17g %.17g %.17g",
+                                (double) rows, (double) count, min, max, mean, m2);
+    for (size_t k = 0; k < counts.size(); k++)
+        os += CPLSPrintf(" %.0f", (double) counts[k]);
+    return os;
+}
+
+inline bool DemStats::SetState(const char *pszState)
+{
+    char **papszFields = CSLTokenizeString2(pszState, " ", 0);
+    const bool bOK = CSLCount(papszFields) == 6 + (int) counts.size();
+
+    if (bOK) {
+        rows  = (GIntBig) atof(papszFields[0]);
+        count = (GIntBig) atof(papszFields[1]);
+        min   = atof(papszFields[2]);
+        max   = atof(papszFields[3]);
+        mean  = atof(papszFields[4]);
+        m2    = atof(papszFields[5]);
+        for (size_t k = 0; k < counts.size(); k++)
+            counts[k] = (GIntBig) atof(papszFields[6 + k]);
+    }
+    CSLDestroy(papszFields);
+    return bOK;
+}
+
+#endif /* DEMSTATS_H */
@@ -0,0 +1,198 @@
+/****************************************************************************
+ * gradient.h
+ * Author: agent
+ * License :
+ Copyright 2026 agent
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ * gradient rasters, saved by hillshade -savegrad for re-rendering
+ *
+ * The gradient of each cell (x and y components in vertical units per
+ * scaled horizontal unit, as ComputeGradient gives them) is kept in a
+ * compressed Int16 GTiff, two bands per DEM band. A component g is stored
+ * as round(32767 * atan(g) / (pi/2)), steps of 0.0027 degrees in the angle
+ * it makes with the horizontal for gentle and steep terrain alike, and
+ * -32768 marks cells without a gradient. Dataset metadata tells the tools
+ * what they are reading:
+ *
+ *   GRADIENT_ENCODING=ATAN_INT16
+ *   GRADIENT_WINDIST=n, GRADIENT_SHARPNESS=s    window it was computed with
+ *   GRADIENT_SCALE=s                            -s it was computed with
+ *   GRADIENT_BANDS=b1,b2,...                    DEM band of each band pair
+ *
+ * -b on a gradient raster takes the DEM's band numbers.
+ *
+ * Given a gradient raster as input, hillshade, slope and aspect compute
+ * every cell from its own gradient: a streaming pass with no window. The
+ * 3x3 window slope and aspect use on a DEM is -wd 1 -sh 2 (Horn's
+ * weights); from a gradient of another window they record the one used.
+ ****************************************************************************/
+
+#ifndef GRADIENT_H
+#define GRADIENT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include "gdal_priv.h"
+#include "cpl_string.h"
+#include "demoutput.h"
+
+#define GRADIENT_ENCODING "ATAN_INT16"
+#define GRADIENT_NODATA   -32768
+#define GRADIENT_STEPS    32767.0
+
+// Stored value of gradient component g (written through a Float32 buffer)
+inline float EncodeGradient(float g)
+{
+    return (float) floor(atan(g) * (GRADIENT_STEPS / (M_PI / 2)) + 0.5);
+}
+
+inline float DecodeGradient(float v)
+{
+    return (float) tan(v * ((M_PI / 2) / GRADIENT_STEPS));
+}
+
+// Record how the gradient in poOut was computed, and from which DEM bands
+inline void SetGradientMetadata(OutputSink *poOut, int winDist, float sharp, float scale,
+                                const std::vector<int> &bands)
+{
+    std::string osBands;
+    for (size_t k = 0; k < bands.size(); k++)
+        osBands += CPLSPrintf(k == 0 ? "%d" : ",%d", bands[k]);
+
+    poOut->SetNoDataValue(GRADIENT_NODATA);
+    poOut->SetMetadataItem("GRADIENT_ENCODING", GRADIENT_ENCODING);
+    poOut->SetMetadataItem("GRADIENT_WINDIST", CPLSPrintf("%d", winDist));
+    poOut->SetMetadataItem("GRADIENT_SHARPNESS", CPLSPrintf("%.9g", sharp));
+    poOut->SetMetadataItem("GRADIENT_SCALE", CPLSPrintf("%.9g", scale));
+    poOut->SetMetadataItem("GRADIENT_BANDS", osBands.c_str());
+}
+
+// True if poDS is a gradient raster; *pfScale is set to the scale it was
+// computed with
+inline bool IsGradientRaster(GDALDataset *poDS, float *pfScale)
+{
+    const char *pszEncoding = poDS->GetMetadataItem("GRADIENT_ENCODING");
+    const char *pszScale    = poDS->GetMetadataItem("GRADIENT_SCALE");
+
+    if (pszEncoding == NULL || !EQUAL(pszEncoding, GRADIENT_ENCODING) ||
+        poDS->GetRasterCount() == 0 || poDS->GetRasterCount() % 2 != 0)
+        return false;
+    for (int iBand = 1; iBand <= poDS->GetRasterCount(); iBand++)
+        if (poDS->GetRasterBand(iBand)->GetRasterDataType() != GDT_Int16)
+            return false;
+    *pfScale = (pszScale != NULL) ? (float) atof(pszScale) : 1.0f;
+    return true;
+}
+
+// Window the gradient raster poDS was computed with (-wd 1 -sh 2 if it
+// doesn't say)
+inline void GetGradientWindow(GDALDataset *poDS, int *pnWinDist, float *pfSharp)
+{
+    const char *pszWinDist = poDS->GetMetadataItem("GRADIENT_WINDIST");
+    const char *pszSharp   = poDS->GetMetadataItem("GRADIENT_SHARPNESS");
+
+    *pnWinDist = (pszWinDist != NULL) ? atoi(pszWinDist) : 1;
+    *pfSharp   = (pszSharp != NULL) ? (float) atof(pszSharp) : 2.0f;
+}
+
+// Warn that slope or aspect from the gradient raster poDS differs from
+// what the DEM would give, and note the window in poOut's metadata
+inline void CheckGradientWindow(GDALDataset *poDS, OutputSink *poOut)
+{
+    int   winDist;
+    float sharp;
+
+    GetGradientWindow(poDS, &winDist, &sharp);
+    if (winDist == 1 && sharp == 2)
+        return;
+    fprintf(stderr, "Warning: the gradient was computed with -wd %d -sh %g, not the 3x3 "
+            "window used on a DEM\n", winDist, sharp);
+    poOut->SetMetadataItem("FROM_GRADIENT_WINDIST", CPLSPrintf("%d", winDist));
+    poOut->SetMetadataItem("FROM_GRADIENT_SHARPNESS", CPLSPrintf("%.9g", sharp));
+}
+
+// DEM bands the gradient raster poDS was saved from, one per band pair
+// (1 to n if it doesn't say)
+inline std::vector<int> GetGradientSourceBands(GDALDataset *poDS)
+{
+    const char      *pszBands = poDS->GetMetadataItem("GRADIENT_BANDS");
+    std::vector<int> sourceBands;
+
+    if (pszBands != NULL) {
+        char **papszBands = CSLTokenizeString2(pszBands, ",", 0);
+        for (int k = 0; papszBands != NULL && papszBands[k] != NULL; k++)
+            sourceBands.push_back(atoi(papszBands[k]));
+        CSLDestroy(papszBands);
+    }
+    if ((int) sourceBands.size() != poDS->GetRasterCount() / 2) {
+        sourceBands.clear();
+        for (int k = 1; k <= poDS->GetRasterCount() / 2; k++)
+            sourceBands.push_back(k);
+    }
+    return sourceBands;
+}
+
+// Resolve the -b options of a tool (DEM band numbers or "all") against
+// the bands the gradient raster poDS was saved from; its first if there
+// were none
+inline bool SelectGradientBands(GDALDataset *poDS, char **papszBands, std::vector<int> &bands)
+{
+    const std::vector<int> sourceBands = GetGradientSourceBands(poDS);
+
+    bands.clear();
+    for (int k = 0; papszBands != NULL && papszBands[k] != NULL; k++) {
+        if (EQUAL(papszBands[k], "all")) {
+            bands.insert(bands.end(), sourceBands.begin(), sourceBands.end());
+            continue;
+        }
+        const int iBand = atoi(papszBands[k]);
+        size_t    n = 0;
+        while (n < sourceBands.size() && sourceBands[n] != iBand)
+            n++;
+        if (n == sourceBands.size()) {
+            std::string osBands;
+            for (n = 0; n < sourceBands.size(); n++)
+                osBands += CPLSPrintf(n == 0 ? "%d" : ", %d", sourceBands[n]);
+            fprintf(stderr, "Band %s is not in the gradient raster (bands %s of the DEM)\n",
+                    papszBands[k], osBands.c_str());
+            return false;
+        }
+        bands.push_back(iBand);
+    }
+    if (bands.empty())
+        bands.push_back(sourceBands[0]);
+    return true;
+}
+
+// Bands of the gradient raster poDS holding the x and y components of
+// each of the DEM bands given (as SelectGradientBands returns them)
+inline std::vector<int> GetGradientBands(GDALDataset *poDS, const std::vector<int> &bands)
+{
+    const std::vector<int> sourceBands = GetGradientSourceBands(poDS);
+    std::vector<int>       gradBands;
+
+    for (size_t k = 0; k < bands.size(); k++) {
+        size_t n = 0;
+        while (n + 1 < sourceBands.size() && sourceBands[n] != bands[k])
+            n++;
+        gradBands.push_back(2 * (int) n + 1);
+        gradBands.push_back(2 * (int) n + 2);
+    }
+    return gradBands;
+}
+
+#endif /* GRADIENT_H */
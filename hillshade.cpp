@@ -25,32 +25,46 @@
 #include <stdlib.h>
 #include <math.h>
 #include "gdal_priv.h"
+#include "shade.h"
+#include "rowwindow.h"
+#include "membudget.h"
+#include "demoutput.h"
+#include "checkpoint.h"
+#include "gradient.h"
+#include "shadows.h"
 
 int main(int nArgc, char ** papszArgv)
 {
     GDALDataset *poDataset;
-    const float radiansToDegrees = 180.0 / 3.14159;
-    const float degreesToRadians = 3.14159 / 180.0;
     double      adfGeoTransform[6];
     float       *win;
     float       *shadeBuf;
-    float  	x;
-    float	y;
-    float   s;
-    float       aspect;
-    float	slope;
-    float       cang;
+    float       *gradXBuf = NULL;
+    float       *gradYBuf = NULL;
+    float       x;
+    float       y;
     int         i;
     int         j;
-    int         n;
-    int         containsNull;
     const char *pszFormat = "GTiff";
+    char      **papszOptions = NULL;
+    int         resume = 0;
+    Checkpoint  checkpoint;
+    int         yOff = 0;
+    int         nOutRows = -1;
     float       z = 1.0;
     float       scale = 1.0;
     float       az = 315.0;
     float       alt = 45.0;
     int         winDist = 1;
     float       sharp = 2;
+    int         windowGiven = 0;
+    int         castShadows = 0;
+    double      zRange = -1;
+    const char *pszGradFilename = NULL;
+    OutputSink *poGradOut = NULL;
+    char      **papszBands = NULL;
+    std::vector<int> bands;
+    MemBudget   budget;
 
     /* -----------------------------------
      * Parse Input Arguments
@@ -62,9 +76,29 @@ int main(int nArgc, char ** papszArgv)
                 "   hillshade input_dem output_hillshade \n"
                 "                 [-z ZFactor (default=1)] [-s scale* (default=1)] \n"
                 "                 [-az Azimuth (default=315)] [-alt Altitude (default=45)]\n"
-                "                 [-wd Halfsize of window (default=1)] [-sh Sharpness coeff (default=2.0)]\n\n"
+                "                 [-wd Halfsize of window (default=1)] [-sh Sharpness coeff (default=2.0)]\n"
+                "                 [-cs cast shadows [-zrange min max]] [-of output format: GTiff or RAW]\n"
+                "                 [-co NAME=VALUE]* [-mem memory budget in MB]\n"
+                "                 [-resume [-ci seconds]] [-rows first count]\n"
+                "                 [-b band]* [-b all] [-savegrad gradient_raster]\n"
+                "   hillshade gradient_raster output_hillshade [options]\n\n"
                 " Notes : \n"
-                "   Scale for Feet:Latlong use scale=370400, for Meters:LatLong use scale=111120 \n\n");
+                "   -cs darkens cells shadowed by terrain toward the sun like slopes facing away;\n"
+                "     -zrange gives the elevation range of the input bands, which otherwise\n"
+                "     comes from their statistics or a min/max pass over them\n"
+                "   -co passes creation options to the driver, e.g. -co COMPRESS=DEFLATE\n"
+                "   -resume checkpoints every 300 seconds (-ci seconds) and, rerun with the\n"
+                "     same arguments, carries on from the last checkpoint\n"
+                "   -rows computes just that strip of the output, reading the rows\n"
+                "     around it from the input (used by demshard)\n"
+                "   -b picks the input bands to shade (default 1) in one pass, giving\n"
+                "     an output band for each\n"
+                "   -savegrad also saves the gradient of each cell to a compact GTiff;\n"
+                "     given that as input, hillshade (or slope or aspect) relights each\n"
+                "     cell from its gradient without the window: -z, -s, -az and -alt\n"
+                "     still apply, -wd and -sh are those it was saved with\n"
+                "   Scale for Feet:Latlong use scale=370400, for Meters:LatLong use scale=111120 \n"
+                "   An output of - streams raw Byte rows to stdout\n\n");
         exit(1);
     }
 
@@ -86,26 +120,92 @@ int main(int nArgc, char ** papszArgv)
             alt = atof(papszArgv[iArg+1]);
         if( EQUAL(papszArgv[iArg],"-wd") ||
                 EQUAL(papszArgv[iArg],"-windist"))
+        {
             winDist = atoi(papszArgv[iArg+1]);
+            windowGiven = 1;
+        }
         if( EQUAL(papszArgv[iArg],"-sh") ||
                 EQUAL(papszArgv[iArg],"-sharpness"))
+        {
             sharp = atof(papszArgv[iArg+1]);
+            windowGiven = 1;
+        }
+        if( EQUAL(papszArgv[iArg],"-cs") ||
+                EQUAL(papszArgv[iArg],"-castshadows"))
+            castShadows = 1;
+        if( EQUAL(papszArgv[iArg],"-zrange") )
+            zRange = atof(papszArgv[iArg+2]) - atof(papszArgv[iArg+1]);
+        if( EQUAL(papszArgv[iArg],"-of") )
+            pszFormat = papszArgv[iArg+1];
+        if( EQUAL(papszArgv[iArg],"-co") )
+            papszOptions = AddCreationOption(papszOptions, papszArgv[iArg+1]);
+        if( EQUAL(papszArgv[iArg],"-resume") )
+            resume = 1;
+        if( EQUAL(papszArgv[iArg],"-ci") )
+            checkpoint.SetInterval(atoi(papszArgv[iArg+1]));
+        if( EQUAL(papszArgv[iArg],"-rows") )
+        {
+            yOff = atoi(papszArgv[iArg+1]);
+            nOutRows = atoi(papszArgv[iArg+2]);
+        }
+        if( EQUAL(papszArgv[iArg],"-mem") )
+            budget.Set(papszArgv[iArg+1]);
+        if( EQUAL(papszArgv[iArg],"-b") )
+            papszBands = CSLAddString(papszBands, papszArgv[iArg+1]);
+        if( EQUAL(papszArgv[iArg],"-savegrad") )
+            pszGradFilename = papszArgv[iArg+1];
+    }
+
+    // The gradient raster covers the whole input in one run
+    if (pszGradFilename != NULL && (resume || nOutRows >= 0))
+    {
+        fprintf( stderr, "-savegrad can't be combined with -resume or -rows\n" );
+        exit(1);
     }
 
+    papszOptions = ApplyCreationDefaults(papszOptions, pszFormat);
     GDALAllRegister();
 
     /*---------------------------------------
-     * Open Dataset and get raster band (assuming it is band #1)
+     * Open Dataset and get the raster bands (band #1 unless -b says otherwise)
      */
     poDataset = (GDALDataset *) GDALOpen( pszFilename, GA_ReadOnly );
     if( poDataset == NULL )
     {
-        printf( "Couldn't open dataset %s\n",
-                pszFilename );
+        fprintf( stderr, "Couldn't open dataset %s\n",
+                 pszFilename );
+        exit(1);
+    }
+
+    // A gradient raster saved by -savegrad stands in for the DEM
+    float       gradScale;
+    const bool  isGradient = IsGradientRaster(poDataset, &gradScale);
+    if (isGradient ? !SelectGradientBands(poDataset, papszBands, bands)
+                   : !SelectBands(poDataset->GetRasterCount(), papszBands, bands))
+        exit(1);
+    const std::vector<int> readBands = isGradient ? GetGradientBands(poDataset, bands) : bands;
+    if (isGradient && pszGradFilename != NULL)
+    {
+        fprintf( stderr, "%s is already a gradient raster\n", pszFilename );
+        exit(1);
+    }
+    int   gradWinDist = 1;
+    float gradSharp = 2;
+    if (isGradient)
+        GetGradientWindow(poDataset, &gradWinDist, &gradSharp);
+    if (isGradient && windowGiven && (winDist != gradWinDist || sharp != gradSharp))
+        fprintf( stderr, "Warning: %s was computed with -wd %d -sh %g; -wd and -sh ignored\n",
+                 pszFilename, gradWinDist, gradSharp );
+    if (isGradient && castShadows)
+    {
+        fprintf( stderr, "Warning: cast shadows need the DEM, not its gradient; -cs ignored\n" );
+        castShadows = 0;
     }
     GDALRasterBand  *poBand;
-    poBand = poDataset->GetRasterBand( 1 );
+    poBand = poDataset->GetRasterBand( readBands[0] );
     poDataset->GetGeoTransform( adfGeoTransform );
+    const int nBands = (int) bands.size();
+    const int nReadBands = isGradient ? 2 * nBands : nBands;
 
     const int winSize = 2 * winDist + 1;
     /* -------------------------------------
@@ -113,114 +213,153 @@ int main(int nArgc, char ** papszArgv)
     */
     const double   nsres = adfGeoTransform[5];
     const double   ewres = adfGeoTransform[1];
-    const float    inputNullValue = (float) poBand->GetNoDataValue( );
     const float    nullValue = 0.0;
     const int      nXSize = poBand->GetXSize();
     const int      nYSize = poBand->GetYSize();
+    if (nOutRows < 0)
+        nOutRows = nYSize - yOff;
+    if (yOff < 0 || nOutRows < 1 || yOff + nOutRows > nYSize)
+    {
+        fprintf( stderr, "Rows %d to %d are outside the input\n",
+                 yOff, yOff + nOutRows - 1 );
+        exit(1);
+    }
     shadeBuf       = (float *) CPLMalloc(sizeof(float)*nXSize);
     win            = (float *) CPLMalloc(sizeof(float)*winSize*winSize);
+    if (pszGradFilename != NULL) {
+        gradXBuf = (float *) CPLMalloc(sizeof(float)*nXSize);
+        gradYBuf = (float *) CPLMalloc(sizeof(float)*nXSize);
+    }
+
+    // One shadow sweep for all the bands, reaching as far as their
+    // elevation range calls for
+    ShadowSweep *poShadows = NULL;
+    double zMin;
+    double zMax;
+    if (castShadows && zRange < 0)
+        zRange = GetElevationRange(poDataset, bands, &zMin, &zMax) ? zMax - zMin : 0;
+    if (castShadows) {
+        poShadows = new ShadowSweep(nXSize, nYSize, nBands, ewres, nsres,
+                                    scale, z, az, alt, zRange);
+        budget.Reserve(poShadows->GetMemorySize());
+    }
+    const int      nChunkRows = budget.PickChunkRows(poBand, nReadBands);
+    const int      nQueueRows = budget.PickQueueRows(sizeof(double)*nXSize, OUTPUT_QUEUE_ROWS);
+    budget.Reserve(BandRowReader::GetMemorySize(nXSize, nReadBands, nChunkRows) +
+                   (isGradient ? 0 : nBands * RowWindow::GetMemorySize(nXSize, winDist)) +
+                   AsyncOutputSink::GetMemorySize(nXSize, nQueueRows) *
+                       (pszGradFilename != NULL ? 2 : 1) +
+                   sizeof(float)*((pszGradFilename != NULL ? 3 : 1) * nXSize + winSize*winSize));
+    if (!budget.ApplyCacheMax())
+        exit(1);
+
+    // A window per band, all reading through one reader (a gradient
+    // raster's x and y bands are read through it too, without windows)
+    BandRowReader  reader(poDataset, readBands, nChunkRows);
+    std::vector<RowWindow *> windows;
+    for (int b = 0; b < nBands && !isGradient; b++)
+        windows.push_back(new RowWindow(&reader, b, winDist));
 
     /* -----------------------------------------
      * Create the output dataset and copy over relevant metadata
      */
-    GDALDriver *poDriver;
-    poDriver = GetGDALDriverManager()->GetDriverByName(pszFormat);
-    GDALDataset      *poShadeDS;
-    GDALRasterBand   *poShadeBand;
-    char **papszOptions = NULL;
+    OutputSink       *poShadeOut;
+
+    if (resume)
+        checkpoint.Enable(pszShadeFilename, pszFormat, pszFilename, nArgc, papszArgv);
+    int         iStartRow;
+    poShadeOut = checkpoint.Resume(nXSize, nOutRows, nQueueRows, &iStartRow);
+    if (poShadeOut == NULL)
+        poShadeOut = CreateOutputSink(pszShadeFilename, pszFormat, nXSize, nOutRows, nBands,
+                                      GDT_Byte, papszOptions, nQueueRows );
+    if (poShadeOut == NULL)
+    {
+        fprintf( stderr, "Couldn't create output %s\n", pszShadeFilename );
+        exit(1);
+    }
+    OffsetGeoTransform( adfGeoTransform, 0, yOff );
+    poShadeOut->SetGeoTransform( adfGeoTransform );
+    poShadeOut->SetProjection( poDataset->GetProjectionRef() );
+    poShadeOut->SetNoDataValue( nullValue );
 
-    poShadeDS = poDriver->Create(pszShadeFilename,nXSize,nYSize,1,GDT_Byte,
-                                 papszOptions );
-    poShadeDS->SetGeoTransform( adfGeoTransform );
-    poShadeDS->SetProjection( poDataset->GetProjectionRef() );
-    poShadeBand = poShadeDS->GetRasterBand(1);
-    poShadeBand->SetNoDataValue( nullValue );
+    if (pszGradFilename != NULL)
+    {
+        char **papszGradOptions = NULL;
+        papszGradOptions = AddCreationOption(papszGradOptions, "COMPRESS=DEFLATE");
+        papszGradOptions = AddCreationOption(papszGradOptions, "PREDICTOR=2");
+        papszGradOptions = ApplyCreationDefaults(papszGradOptions, "GTiff");
+        poGradOut = CreateOutputSink(pszGradFilename, "GTiff", nXSize, nYSize, 2 * nBands,
+                                     GDT_Int16, papszGradOptions, nQueueRows );
+        CSLDestroy(papszGradOptions);
+        if (poGradOut == NULL)
+        {
+            fprintf( stderr, "Couldn't create output %s\n", pszGradFilename );
+            exit(1);
+        }
+        poGradOut->SetGeoTransform( adfGeoTransform );
+        poGradOut->SetProjection( poDataset->GetProjectionRef() );
+        SetGradientMetadata( poGradOut, winDist, sharp, scale, bands );
+    }
 
 
     /* ------------------------------------------
      * Move a SxS window over each cell
      * (where the cell in question is (winSize + 1) * winDist)
      */
-    for ( i = 0; i < nYSize; i++) {
-        for ( j = 0; j < nXSize; j++) {
-            containsNull = 0;
-
-            // Exclude the edges
-            if (i < winDist || j < winDist || i >= nYSize-winDist || j >= nXSize-winDist )
+    for ( i = yOff + iStartRow; i < yOff + nOutRows; i++) {
+      for ( int b = 0; b < nBands; b++ ) {
+        if (isGradient) {
+            // Relight each cell from its saved gradient alone
+            const float *gradX = reader.GetRow(2 * b, i);
+            const float *gradY = reader.GetRow(2 * b + 1, i);
+
+            for ( j = 0; j < nXSize; j++) {
+                if (gradX[j] == GRADIENT_NODATA || gradY[j] == GRADIENT_NODATA) {
+                    shadeBuf[j] = nullValue;
+                    continue;
+                }
+                x = DecodeGradient(gradX[j]) * gradScale / scale;
+                y = DecodeGradient(gradY[j]) * gradScale / scale;
+                shadeBuf[j] = ShadeFromGradient(x, y, z, az, alt);
+            }
+            if (!poShadeOut->WriteRow( b + 1, i - yOff, shadeBuf, GDT_Float32 ))
             {
-                // We are at the edge so write nullValue and move on
-                shadeBuf[j] = nullValue;
-                continue;
+                fprintf( stderr, "Couldn't write %s\n", pszShadeFilename );
+                exit(1);
             }
+            continue;
+        }
 
-            // Read in 3x3 window
-            poBand->RasterIO( GF_Read, j-winDist, i-winDist, winSize, winSize,
-                              win, winSize, winSize, GDT_Float32,
-                              0, 0 );
+        RowWindow   &window = *windows[b];
+        const GByte *shadowRow = castShadows ? poShadows->GetRow(reader, b, i) : NULL;
 
-            // Check if window has null value
-            for ( n = 0; n < winSize*winSize; n++) {
-                if(win[n] == inputNullValue) {
-                    containsNull = 1;
-                    break;
-                }
-            }
+        window.Advance(i);
 
-            if (containsNull == 1) {
-                // We have nulls so write nullValue and move on
+        for ( j = 0; j < nXSize; j++) {
+            // Skip the edges and windows containing nodata
+            if (!window.IsValid(j)) {
+                // Write nullValue and move on
                 shadeBuf[j] = nullValue;
+                if (gradXBuf != NULL)
+                    gradXBuf[j] = gradYBuf[j] = GRADIENT_NODATA;
                 continue;
             } else {
                 // We have a valid SxS window.
+                window.GetWindow(j, win);
 
                 /* ---------------------------------------
                 * Compute Hillshade
                 */
-
-                x = 0;
-                y = 0;
-                s = 0;
-
-                for (int i = 1; i <= winDist; ++ i) {
-                    const int wd = winDist;
-                    const int ws = winSize;
-
-                    for (int j = 1; j <= winDist; ++ j ) {
-                        double c = pow(sharp, 2*winDist - i - j);
-
-                        s += c * 4;
-                        x += (win[wd - i + (wd - j)*ws ] + win[wd - i + (wd + j)*ws] - win[wd + i + (wd - j)*ws] - win[wd + i + (wd + j)*ws]) * c;
-                        y += (win[wd - j + (wd + i)*ws ] + win[wd + j + (wd + i)*ws] - win[wd - j + (wd - i)*ws] - win[wd + j + (wd - i)*ws]) * c;
-                    }
-
-                    double c = pow(sharp, 2*winDist - i);
-
-                    s += c * 2;
-                    x += (win[wd - i + wd*ws ] - win[wd + i + wd*ws]) * c;
-                    y += (win[wd + (wd+i)*ws ] - win[wd + (wd-i)*ws]) * c;
+                ComputeGradient(win, winDist, sharp, ewres, nsres, scale, &x, &y);
+                shadeBuf[j] = ShadeFromGradient(x, y, z, az, alt);
+                if (gradXBuf != NULL) {
+                    gradXBuf[j] = EncodeGradient(x);
+                    gradYBuf[j] = EncodeGradient(y);
                 }
 
-                x /= s * ewres * scale;
-                y /= s * nsres * scale;
-                x *= z; // Scale by user-defined factor
-                y *= z; // Scale by user-defined factor
-
-                slope = 90.0 - atan(sqrt(x*x + y*y))*radiansToDegrees;
-
-                // ... then aspect...
-                aspect = atan2(x,y);
-
-                // ... then the shade value
-                cang = sin(alt*degreesToRadians) * sin(slope*degreesToRadians) +
-                       cos(alt*degreesToRadians) * cos(slope*degreesToRadians) *
-                       cos((az-90.0)*degreesToRadians - aspect);
-
-                if (cang <= 0.0) 
-                    cang = 1.0;
-                else
-                    cang = 1.0 + (254.0 * cang);
-
-                shadeBuf[j] = cang;
+                // Cast shadows get the same value as slopes facing away
+                if (shadowRow != NULL && (shadowRow[j >> 3] & (1 << (j & 7))))
+                    shadeBuf[j] = 1.0;
 
             }
         }
@@ -228,12 +367,44 @@ int main(int nArgc, char ** papszArgv)
         /* -----------------------------------------
          * Write Line to Raster
          */
-        poShadeBand->RasterIO( GF_Write, 0, i, nXSize, 1,
-                               shadeBuf, nXSize, 1, GDT_Float32, 0, 0 );
+        if (!poShadeOut->WriteRow( b + 1, i - yOff, shadeBuf, GDT_Float32 ))
+        {
+            fprintf( stderr, "Couldn't write %s\n", pszShadeFilename );
+            exit(1);
+        }
+        if (poGradOut != NULL &&
+            !(poGradOut->WriteRow( 2 * b + 1, i, gradXBuf, GDT_Float32 ) &&
+              poGradOut->WriteRow( 2 * b + 2, i, gradYBuf, GDT_Float32 )))
+        {
+            fprintf( stderr, "Couldn't write %s\n", pszGradFilename );
+            exit(1);
+        }
+      }
+      checkpoint.RowDone( poShadeOut, i - yOff + 1 );
 
     }
 
-    delete poShadeDS;
+    if (!poShadeOut->Flush())
+    {
+        fprintf( stderr, "Couldn't write %s\n", pszShadeFilename );
+        exit(1);
+    }
+    if (poGradOut != NULL && !poGradOut->Flush())
+    {
+        fprintf( stderr, "Couldn't write %s\n", pszGradFilename );
+        exit(1);
+    }
+    delete poShadeOut;
+    delete poGradOut;
+    checkpoint.Finish();
+    for (size_t b = 0; b < windows.size(); b++)
+        delete windows[b];
+    delete poShadows;
+    CPLFree(gradXBuf);
+    CPLFree(gradYBuf);
+    CSLDestroy(papszBands);
+    CSLDestroy(papszOptions);
+    ReportPeakRSS(budget);
 
     return 0;
 
@@ -0,0 +1,164 @@
+/****************************************************************************
+ * membudget.h
+ * Author: agent
+ * License : 
+ Copyright 2026 agent
+ Licensed under the Apache License, Version 2.0 (the "License"); 
+ you may not use this file except in compliance with the License. 
+ You may obtain a copy of the License at 
+ 
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software 
+ distributed under the License is distributed on an "AS IS" BASIS, 
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+ See the License for the specific language governing permissions and 
+ limitations under the License.
+
+ * memory budget shared by the tools (-mem option)
+ *
+ * The tools reserve their own buffers (rows in flight, lookup tables,
+ * queues) against the budget first; whatever is left becomes the GDAL
+ * block cache. Buffers are cut down to fit (single-row reads, no write
+ * queue) and a budget too small even for those is an error. Input rows are read in chunks of whole block rows when the
+ * budget allows, so a tiled input never needs more than one block row in
+ * the cache.
+ ****************************************************************************/
+
+#ifndef MEMBUDGET_H
+#define MEMBUDGET_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "gdal_priv.h"
+
+#ifdef _WIN32
+#  include <windows.h>
+#  include <psapi.h>
+#else
+#  include <sys/resource.h>
+#endif
+
+// Smallest GDAL block cache we are willing to run with
+#define MEMBUDGET_MIN_CACHE (4 * 1024 * 1024)
+
+class MemBudget
+{
+public:
+    MemBudget() : nBudget(0), nReserved(0) {}
+
+    // Parse a size such as "512", "512M" or "2G" (megabytes by default)
+    void Set(const char *pszSize);
+
+    bool    IsSet() const { return nBudget > 0; }
+    GIntBig GetBudget() const { return nBudget; }
+    GIntBig GetAvailable() const { return nBudget - nReserved; }
+
+    // Account for a buffer allocated by the tool
+    void Reserve(GIntBig nBytes) { nReserved += nBytes; }
+
+    // Number of input rows to read per RasterIO call: a whole block row of
+    // the band (of nBands such bands read together) if that fits in a
+    // quarter of what is left, otherwise 1
+    int  PickChunkRows(GDALRasterBand *poBand, int nBands = 1) const;
+
+    // Number of output rows to queue for the writer thread: nDefault, or
+    // fewer if that takes more than a quarter of what is left, or 0 (write
+    // in the computing thread) if not even 2 rows fit
+    int  PickQueueRows(GIntBig nRowBytes, int nDefault) const;
+
+    // Hand what is left of the budget to the GDAL block cache. Returns
+    // false, with a message giving the budget needed, if the tool's own
+    // buffers leave less than the smallest cache
+    bool ApplyCacheMax() const;
+
+private:
+    GIntBig nBudget;
+    GIntBig nReserved;
+};
+
+inline void MemBudget::Set(const char *pszSize)
+{
+    char  *pszEnd;
+    double dfSize = strtod(pszSize, &pszEnd);
+
+    if (*pszEnd == 'k' || *pszEnd == 'K')
+        dfSize *= 1024;
+    else if (*pszEnd == 'g' || *pszEnd == 'G')
+        dfSize *= 1024.0 * 1024 * 1024;
+    else
+        dfSize *= 1024 * 1024;
+    nBudget = (GIntBig) dfSize;
+}
+
+inline int MemBudget::PickChunkRows(GDALRasterBand *poBand, int nBands) const
+{
+    int nBlockXSize;
+    int nBlockYSize;
+
+    if (!IsSet())
+        return 1;
+
+    poBand->GetBlockSize(&nBlockXSize, &nBlockYSize);
+    const GIntBig nChunkBytes = (GIntBig) nBlockYSize * poBand->GetXSize() * sizeof(float) * nBands;
+    if (nBlockYSize > 1 && nChunkBytes <= GetAvailable() / 4)
+        return nBlockYSize;
+    return 1;
+}
+
+inline int MemBudget::PickQueueRows(GIntBig nRowBytes, int nDefault) const
+{
+    if (!IsSet() || nRowBytes <= 0)
+        return nDefault;
+
+    GIntBig nRows = GetAvailable() / 4 / nRowBytes;
+    if (nRows < 2)
+        return 0;
+    return (nRows < nDefault) ? (int) nRows : nDefault;
+}
+
+inline bool MemBudget::ApplyCacheMax() const
+{
+    if (!IsSet())
+        return true;
+
+    if (GetAvailable() < MEMBUDGET_MIN_CACHE) {
+        fprintf(stderr, "A memory budget of %.1f MB is too small, this needs at least %.1f MB\n",
+                nBudget / 1048576.0, (nReserved + MEMBUDGET_MIN_CACHE) / 1048576.0);
+        return false;
+    }
+    GDALSetCacheMax64(GetAvailable());
+    return true;
+}
+
+/* -----------------------------------------
+ * Peak resident set size of the process, in bytes
+ */
+inline GIntBig GetPeakRSS()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return (GIntBig) pmc.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#  ifdef __APPLE__
+    return (GIntBig) usage.ru_maxrss;
+#  else
+    return (GIntBig) usage.ru_maxrss * 1024;
+#  endif
+#endif
+}
+
+inline void ReportPeakRSS(const MemBudget &budget)
+{
+    if (!budget.IsSet())
+        return;
+    fprintf(stderr, "Peak memory: %.1f MB (budget %.1f MB)\n",
+            GetPeakRSS() / 1048576.0, budget.GetBudget() / 1048576.0);
+}
+
+#endif /* MEMBUDGET_H */
@@ -0,0 +1,372 @@
+/****************************************************************************
+ * rowwindow.h
+ * Author: agent
+ * License : 
+ Copyright 2026 agent
+ Licensed under the Apache License, Version 2.0 (the "License"); 
+ you may not use this file except in compliance with the License. 
+ You may obtain a copy of the License at 
+ 
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software 
+ distributed under the License is distributed on an "AS IS" BASIS, 
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+ See the License for the specific language governing permissions and 
+ limitations under the License.
+
+ * streams a raster band through a moving window of rows
+ *
+ * The rows of a (2 * winDist + 1)^2 window are kept in memory, so every
+ * input row is read once. When a row is loaded its cells are checked for
+ * nodata a single time and the result is kept as a bitmask (1 = invalid).
+ * The invalid cells of each column over the rows in flight are counted as
+ * rows enter and leave the window, which gives the OR of their masks at a
+ * cost that doesn't grow with the window: only words with nodata in the
+ * row entering or leaving are touched. The validity of a window then only
+ * needs the few words covering its columns; windows far from nodata never
+ * look at individual cells.
+ *
+ * The rows come from a BandRowReader, which reads them in chunks; several
+ * bands of a dataset are processed in one pass by a reader of all of them
+ * and a RowWindow per band taking its rows from it.
+ ****************************************************************************/
+
+#ifndef ROWWINDOW_H
+#define ROWWINDOW_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "gdal_priv.h"
+
+// Resolve the -b options of a tool (band numbers or "all") against the
+// nBandCount bands of its input; band 1 if there were none
+inline bool SelectBands(int nBandCount, char **papszBands, std::vector<int> &bands)
+{
+    bands.clear();
+    for (int k = 0; papszBands != NULL && papszBands[k] != NULL; k++) {
+        if (EQUAL(papszBands[k], "all")) {
+            for (int iBand = 1; iBand <= nBandCount; iBand++)
+                bands.push_back(iBand);
+            continue;
+        }
+        const int iBand = atoi(papszBands[k]);
+        if (iBand < 1 || iBand > nBandCount) {
+            fprintf(stderr, "Band %s is not in the input (1 to %d)\n",
+                    papszBands[k], nBandCount);
+            return false;
+        }
+        bands.push_back(iBand);
+    }
+    if (bands.empty())
+        bands.push_back(1);
+    return true;
+}
+
+// Lowest and highest value over the given bands of poDS, from their
+// statistics when those are exact, otherwise from a min/max pass over
+// each band; false if there is no data
+inline bool GetElevationRange(GDALDataset *poDS, const std::vector<int> &bands,
+                              double *pdfMin, double *pdfMax)
+{
+    bool   bFound = false;
+
+    for (size_t k = 0; k < bands.size(); k++) {
+        GDALRasterBand *poBand = poDS->GetRasterBand(bands[k]);
+        const char *pszApprox = poBand->GetMetadataItem("STATISTICS_APPROXIMATE");
+        double      adfMinMax[2];
+        int         bGotMin;
+        int         bGotMax;
+
+        adfMinMax[0] = poBand->GetMinimum(&bGotMin);
+        adfMinMax[1] = poBand->GetMaximum(&bGotMax);
+        if (!bGotMin || !bGotMax || (pszApprox != NULL && EQUAL(pszApprox, "YES"))) {
+            if (poBand->ComputeRasterMinMax(FALSE, adfMinMax) != CE_None)
+                continue;
+        }
+        if (!bFound || adfMinMax[0] < *pdfMin)
+            *pdfMin = adfMinMax[0];
+        if (!bFound || adfMinMax[1] > *pdfMax)
+            *pdfMax = adfMinMax[1];
+        bFound = true;
+    }
+    return bFound;
+}
+
+/* -----------------------------------------
+ * Rows of several bands of a dataset read together: one RasterIO per chunk
+ * of rows covers all of them, which for a pixel interleaved input is a
+ * single pass over its blocks instead of one per band
+ */
+class BandRowReader
+{
+public:
+    BandRowReader(GDALDataset *poDS, const std::vector<int> &bands, int nChunkRows = 1);
+    ~BandRowReader() { CPLFree(chunk); }
+
+    // Bytes allocated by a reader of these dimensions
+    static GIntBig GetMemorySize(int nXSize, int nBands, int nChunkRows = 1)
+        { return (GIntBig) sizeof(float) * nXSize * nBands * (nChunkRows > 1 ? nChunkRows : 1); }
+
+    int             GetBandCount() const { return (int) bands.size(); }
+    GDALRasterBand *GetBand(int k) const { return poDS->GetRasterBand(bands[k]); }
+
+    // Row iRow of the k-th band read
+    const float *GetRow(int k, int iRow);
+
+private:
+    GDALDataset     *poDS;
+    std::vector<int> bands;
+    int              nXSize;
+    int              nYSize;
+    int              nChunkRows;
+    int              iChunkFirst;
+    int              nChunkCount;
+    float           *chunk;
+};
+
+inline BandRowReader::BandRowReader(GDALDataset *poDSIn, const std::vector<int> &bandsIn,
+                                    int nChunkRowsIn)
+{
+    poDS        = poDSIn;
+    bands       = bandsIn;
+    nXSize      = poDS->GetRasterXSize();
+    nYSize      = poDS->GetRasterYSize();
+    nChunkRows  = (nChunkRowsIn > 1) ? nChunkRowsIn : 1;
+    iChunkFirst = 0;
+    nChunkCount = 0;
+    chunk       = (float *) CPLMalloc(sizeof(float)*nXSize*nChunkRows*bands.size());
+}
+
+inline const float *BandRowReader::GetRow(int k, int iRow)
+{
+    if (iRow < iChunkFirst || iRow >= iChunkFirst + nChunkCount) {
+        // Keep chunks aligned with the input's block rows
+        iChunkFirst = iRow - iRow % nChunkRows;
+        nChunkCount = nYSize - iChunkFirst;
+        if (nChunkCount > nChunkRows)
+            nChunkCount = nChunkRows;
+        poDS->RasterIO( GF_Read, 0, iChunkFirst, nXSize, nChunkCount,
+                        chunk, nXSize, nChunkCount, GDT_Float32,
+                        (int) bands.size(), &bands[0], 0, 0, 0 );
+    }
+    // Band sequential: each band's rows of the chunk follow the last's
+    return chunk + ((size_t) k * nChunkCount + (iRow - iChunkFirst)) * nXSize;
+}
+
+class RowWindow
+{
+public:
+    // Window over the k-th band of a reader, which does the reading
+    RowWindow(BandRowReader *poReader, int k, int winDist);
+    ~RowWindow();
+
+    // Bytes allocated by a window of these dimensions
+    static GIntBig GetMemorySize(int nXSize, int winDist);
+
+    // Center the window on row iRow (reading only new rows when moving down)
+    void Advance(int iRow);
+
+    // True if the window around column iCol of the current row lies inside
+    // the raster and contains no nodata
+    bool IsValid(int iCol) const;
+
+    // Copy the window around column iCol into win (winSize * winSize, row major)
+    void GetWindow(int iCol, float *win) const;
+
+    // Row iRow + dRow of the window, -winDist <= dRow <= winDist
+    const float *GetRow(int dRow) const { return rows[winDist + dRow]; }
+
+    // Validity mask of row iRow + dRow (bit set = nodata or outside the raster)
+    const GUInt32 *GetMask(int dRow) const { return masks[winDist + dRow]; }
+
+    bool  HasNoData() const { return hasNoData; }
+    float GetNoDataValue() const { return noData; }
+
+private:
+    void LoadRow(int slot, int iRow);
+    void CountMask(const GUInt32 *mask, int delta);
+
+    BandRowReader  *poReader;
+    int             iReaderBand;
+    int             nXSize;
+    int             nYSize;
+    int             winDist;
+    int             winSize;
+    int             nWords;
+    int             iCurRow;
+    bool            hasNoData;
+    float           noData;
+    float         **rows;
+    GUInt32       **masks;
+    GUInt32        *windowMask;
+    int            *colInvalid;
+};
+
+inline RowWindow::RowWindow(BandRowReader *poReaderIn, int k, int winDistIn)
+{
+    GDALRasterBand *poBand = poReaderIn->GetBand(k);
+    int             bSuccess;
+
+    poReader    = poReaderIn;
+    iReaderBand = k;
+    nXSize     = poBand->GetXSize();
+    nYSize     = poBand->GetYSize();
+    winDist    = winDistIn;
+    winSize    = 2 * winDist + 1;
+    nWords     = (nXSize + 31) / 32;
+    iCurRow    = -winSize - 1;
+    noData     = (float) poBand->GetNoDataValue( &bSuccess );
+    hasNoData  = (bSuccess != 0);
+
+    rows       = (float **) CPLMalloc(sizeof(float*)*winSize);
+    masks      = (GUInt32 **) CPLMalloc(sizeof(GUInt32*)*winSize);
+    for (int k = 0; k < winSize; k++) {
+        rows[k]  = (float *) CPLMalloc(sizeof(float)*nXSize);
+        masks[k] = (GUInt32 *) CPLMalloc(sizeof(GUInt32)*nWords);
+    }
+    windowMask = (GUInt32 *) CPLMalloc(sizeof(GUInt32)*nWords);
+    colInvalid = (int *) CPLMalloc(sizeof(int)*nXSize);
+}
+
+inline RowWindow::~RowWindow()
+{
+    for (int k = 0; k < winSize; k++) {
+        CPLFree(rows[k]);
+        CPLFree(masks[k]);
+    }
+    CPLFree(rows);
+    CPLFree(masks);
+    CPLFree(windowMask);
+    CPLFree(colInvalid);
+}
+
+inline GIntBig RowWindow::GetMemorySize(int nXSize, int winDist)
+{
+    const GIntBig nRowBytes  = (GIntBig) sizeof(float) * nXSize;
+    const GIntBig nMaskBytes = (GIntBig) sizeof(GUInt32) * ((nXSize + 31) / 32);
+    const int     winSize    = 2 * winDist + 1;
+
+    return winSize * (nRowBytes + nMaskBytes) + nMaskBytes + (GIntBig) sizeof(int) * nXSize;
+}
+
+inline void RowWindow::LoadRow(int slot, int iRow)
+{
+    GUInt32 *mask = masks[slot];
+
+    // Rows outside the raster are entirely invalid
+    if (iRow < 0 || iRow >= nYSize) {
+        for (int w = 0; w < nWords; w++)
+            mask[w] = ~0u;
+        return;
+    }
+
+    float *row = rows[slot];
+    memcpy(row, poReader->GetRow(iReaderBand, iRow), sizeof(float)*nXSize);
+
+    // NaN never compares equal, so it is tested on its own and always
+    // treated as nodata whether or not the band declares a nodata value
+    const bool noDataIsNan = hasNoData && noData != noData;
+    for (int w = 0; w < nWords; w++) {
+        const int first = w * 32;
+        const int count = (nXSize - first < 32) ? nXSize - first : 32;
+        GUInt32 bits = 0;
+
+        if (hasNoData && !noDataIsNan) {
+            for (int b = 0; b < count; b++) {
+                const float v = row[first + b];
+                if (v == noData || v != v)
+                    bits |= 1u << b;
+            }
+        } else {
+            for (int b = 0; b < count; b++) {
+                const float v = row[first + b];
+                if (v != v)
+                    bits |= 1u << b;
+            }
+        }
+        mask[w] = bits;
+    }
+}
+
+// Add (delta 1) or remove (delta -1) a row's mask from the column counts
+// and refresh the window mask words it touches
+inline void RowWindow::CountMask(const GUInt32 *mask, int delta)
+{
+    for (int w = 0; w < nWords; w++) {
+        if (mask[w] == 0)
+            continue;
+
+        const int first = w * 32;
+        const int count = (nXSize - first < 32) ? nXSize - first : 32;
+        GUInt32 bits = 0;
+        for (int b = 0; b < count; b++) {
+            if (mask[w] & (1u << b))
+                colInvalid[first + b] += delta;
+            if (colInvalid[first + b] != 0)
+                bits |= 1u << b;
+        }
+        windowMask[w] = bits;
+    }
+}
+
+inline void RowWindow::Advance(int iRow)
+{
+    if (iRow == iCurRow + 1) {
+        // Recycle the top row's buffers for the new bottom row
+        float   *oldRow  = rows[0];
+        GUInt32 *oldMask = masks[0];
+        CountMask(oldMask, -1);
+        for (int k = 0; k < winSize - 1; k++) {
+            rows[k]  = rows[k+1];
+            masks[k] = masks[k+1];
+        }
+        rows[winSize-1]  = oldRow;
+        masks[winSize-1] = oldMask;
+        LoadRow(winSize - 1, iRow + winDist);
+        CountMask(masks[winSize-1], 1);
+    } else {
+        memset(colInvalid, 0, sizeof(int)*nXSize);
+        memset(windowMask, 0, sizeof(GUInt32)*nWords);
+        for (int k = 0; k < winSize; k++) {
+            LoadRow(k, iRow - winDist + k);
+            CountMask(masks[k], 1);
+        }
+    }
+    iCurRow = iRow;
+}
+
+inline bool RowWindow::IsValid(int iCol) const
+{
+    // Exclude the edges
+    if (iCol < winDist || iCol >= nXSize - winDist)
+        return false;
+
+    const int first = iCol - winDist;
+    const int last  = iCol + winDist;
+    for (int w = first >> 5; w <= last >> 5; w++) {
+        GUInt32 bits = windowMask[w];
+        if (bits == 0)
+            continue;
+        if (w == first >> 5)
+            bits &= ~0u << (first & 31);
+        if (w == last >> 5)
+            bits &= ~0u >> (31 - (last & 31));
+        if (bits != 0)
+            return false;
+    }
+    return true;
+}
+
+inline void RowWindow::GetWindow(int iCol, float *win) const
+{
+    for (int k = 0; k < winSize; k++) {
+        const float *row = rows[k] + iCol - winDist;
+        for (int n = 0; n < winSize; n++)
+            win[k*winSize + n] = row[n];
+    }
+}
+
+#endif /* ROWWINDOW_H */
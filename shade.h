@@ -0,0 +1,108 @@
+/****************************************************************************
+ * shade.h
+ * Author: Matthew Perry
+ * License : 
+ Copyright 2005 Matthew T. Perry
+ Licensed under the Apache License, Version 2.0 (the "License"); 
+ you may not use this file except in compliance with the License. 
+ You may obtain a copy of the License at 
+ 
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software 
+ distributed under the License is distributed on an "AS IS" BASIS, 
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+ See the License for the specific language governing permissions and 
+ limitations under the License.
+
+ * shaded relief value of a window, shared by hillshade and color-relief
+ ****************************************************************************/
+
+#ifndef SHADE_H
+#define SHADE_H
+
+#include <math.h>
+
+/* -----------------------------------------
+ * Compute the weighted gradient of the center cell of a
+ * winSize x winSize window (winSize = 2 * winDist + 1) in
+ * vertical units per horizontal unit
+ */
+inline void ComputeGradient(const float *win, int winDist, float sharp,
+                            double ewres, double nsres, float scale,
+                            float *px, float *py)
+{
+    const int   wd = winDist;
+    const int   ws = 2 * winDist + 1;
+    float       x = 0;
+    float       y = 0;
+    float       s = 0;
+
+    for (int i = 1; i <= winDist; ++ i) {
+        for (int j = 1; j <= winDist; ++ j ) {
+            double c = pow(sharp, 2*winDist - i - j);
+
+            s += c * 4;
+            x += (win[wd - i + (wd - j)*ws ] + win[wd - i + (wd + j)*ws] - win[wd + i + (wd - j)*ws] - win[wd + i + (wd + j)*ws]) * c;
+            y += (win[wd - j + (wd + i)*ws ] + win[wd + j + (wd + i)*ws] - win[wd - j + (wd - i)*ws] - win[wd + j + (wd - i)*ws]) * c;
+        }
+
+        double c = pow(sharp, 2*winDist - i);
+
+        s += c * 2;
+        x += (win[wd - i + wd*ws ] - win[wd + i + wd*ws]) * c;
+        y += (win[wd + (wd+i)*ws ] - win[wd + (wd-i)*ws]) * c;
+    }
+
+    *px = x / (s * ewres * scale);
+    *py = y / (s * nsres * scale);
+}
+
+/* -----------------------------------------
+ * Compute the shade value (1 - 255) from a gradient.
+ * 0 is left free for null cells.
+ */
+inline float ShadeFromGradient(float x, float y, float z, float az, float alt)
+{
+    const float radiansToDegrees = 180.0 / 3.14159;
+    const float degreesToRadians = 3.14159 / 180.0;
+    float       slope;
+    float       aspect;
+    float       cang;
+
+    x *= z; // Scale by user-defined factor
+    y *= z; // Scale by user-defined factor
+
+    slope = 90.0 - atan(sqrt(x*x + y*y))*radiansToDegrees;
+
+    // ... then aspect...
+    aspect = atan2(x,y);
+
+    // ... then the shade value
+    cang = sin(alt*degreesToRadians) * sin(slope*degreesToRadians) +
+           cos(alt*degreesToRadians) * cos(slope*degreesToRadians) *
+           cos((az-90.0)*degreesToRadians - aspect);
+
+    if (cang <= 0.0) 
+        cang = 1.0;
+    else
+        cang = 1.0 + (254.0 * cang);
+
+    return cang;
+}
+
+/* -----------------------------------------
+ * Compute the shade value (1 - 255) of the center cell of a window
+ */
+inline float ComputeShade(const float *win, int winDist, float sharp,
+                          double ewres, double nsres, float scale, float z,
+                          float az, float alt)
+{
+    float x;
+    float y;
+
+    ComputeGradient(win, winDist, sharp, ewres, nsres, scale, &x, &y);
+    return ShadeFromGradient(x, y, z, az, alt);
+}
+
+#endif /* SHADE_H */
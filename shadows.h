@@ -0,0 +1,224 @@
+/****************************************************************************
+ * shadows.h
+ * Author: agent
+ * License :
+ Copyright 2026 agent
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+ * cast shadows of hillshade -cs
+ ****************************************************************************/
+
+#ifndef SHADOWS_H
+#define SHADOWS_H
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "gdal_priv.h"
+#include "rowwindow.h"
+
+#define NO_HEIGHT -1e30
+
+/* -----------------------------------------
+ * Interpolate between two horizon candidates. If one is missing
+ * (outside the raster or nodata) the other is used when it is the closer.
+ */
+inline double LerpHeight(double a, double b, double t)
+{
+    if (a <= NO_HEIGHT)
+        return (t >= 0.5) ? b : NO_HEIGHT;
+    if (b <= NO_HEIGHT)
+        return (t < 0.5) ? a : NO_HEIGHT;
+    return a + (b - a) * t;
+}
+
+/* -----------------------------------------
+ * Cast shadows, computed with a line sweep toward the sun as the rows
+ * are shaded
+ *
+ * Rows are swept starting from the side facing the sun. Each cell's
+ * predecessor is the point one step toward the sun, interpolated between
+ * two cells that are already swept (in the previous row, or in the
+ * previous column when the sun is closer to east/west). The horizon of a
+ * cell is the higher of its predecessor's horizon and elevation, lowered
+ * by step * tan(alt); a cell below its horizon is in shadow.
+ *
+ * A horizon drops below the lowest cell after so many rows (the reach,
+ * from the elevation range), so only that many rows
+ * toward the sun can shadow a cell. The bands are swept together, in
+ * blocks of at least the reach, each starting that far out on the sun
+ * side, reading rows through the same reader as the windows: memory is a
+ * block of shadow bits per band, and as blocks are at fixed rows a strip
+ * computed with -rows matches the same rows of the whole output.
+ */
+class ShadowSweep
+{
+public:
+    ShadowSweep(int nXSize, int nYSize, int nBands, double ewres, double nsres,
+                float scale, float z, float az, float alt, double zRange);
+    ~ShadowSweep();
+
+    GIntBig GetMemorySize() const
+        { return (GIntBig) nBands * ((GIntBig) nBlockRows * nRowBytes +
+                                     (GIntBig) nXSize * 2 * sizeof(double)); }
+
+    // Shadow bits of row iRow of the k-th band of reader, 1 = in shadow
+    const GByte *GetRow(BandRowReader &reader, int k, int iRow);
+
+    // Rows of the DEM read for the shadows of rows iFirstRow to iLastRow:
+    // their blocks and the reach beyond them toward the sun
+    void GetInputRows(int iFirstRow, int iLastRow, int *piReadFirst, int *piReadLast) const;
+
+private:
+    void SweepBlock(BandRowReader &reader, int iFirst);
+
+    int     nXSize;
+    int     nYSize;
+    int     nBands;
+    float   z;
+    int     rowStep;
+    int     colStep;
+    bool    rowMajor;
+    double  shift;
+    double  drop;
+    int     nReach;
+    int     nBlockRows;
+    int     nRowBytes;
+    int     iBlockFirst;
+    GByte  *mask;
+    double *cur;
+    double *prev;
+};
+
+inline ShadowSweep::ShadowSweep(int nXSizeIn, int nYSizeIn, int nBandsIn, double ewres, double nsres,
+                                float scale, float zIn, float az, float alt, double zRange)
+    : nXSize(nXSizeIn), nYSize(nYSizeIn), nBands(nBandsIn), z(zIn), iBlockFirst(-1)
+{
+    const double degreesToRadians = 3.14159 / 180.0;
+
+    // Direction toward the sun, in cells per (scaled) horizontal unit
+    const double vc = sin(az*degreesToRadians) / (ewres * scale);
+    const double vr = cos(az*degreesToRadians) / (nsres * scale);
+    rowStep = (vr < 0) ? -1 : 1;
+    colStep = (vc < 0) ? -1 : 1;
+    rowMajor = fabs(vr) >= fabs(vc);
+    const double stepLen = rowMajor ? 1.0 / fabs(vr) : 1.0 / fabs(vc);
+    shift = rowMajor ? fabs(vc / vr) : fabs(vr / vc);
+    drop = stepLen * tan(alt*degreesToRadians);
+
+    // Steps for a horizon to drop through the elevation range, in rows
+    double reach = nYSize;
+    if (drop > 0)
+        reach = ceil((floor(zRange * fabs(z) / drop) + 1) * (rowMajor ? 1.0 : shift)) + 1;
+    nReach = (reach < nYSize) ? (int) reach : nYSize;
+    nBlockRows = (nReach > 256) ? nReach : 256;
+    if (nBlockRows > nYSize)
+        nBlockRows = nYSize;
+    nRowBytes = (nXSize + 7) / 8;
+
+    mask = (GByte *) CPLMalloc((size_t) nBands * nBlockRows * nRowBytes);
+    cur  = (double *) CPLMalloc(sizeof(double)*nXSize*nBands);
+    prev = (double *) CPLMalloc(sizeof(double)*nXSize*nBands);
+}
+
+inline ShadowSweep::~ShadowSweep()
+{
+    CPLFree(mask);
+    CPLFree(cur);
+    CPLFree(prev);
+}
+
+inline const GByte *ShadowSweep::GetRow(BandRowReader &reader, int k, int iRow)
+{
+    const int iFirst = iRow - iRow % nBlockRows;
+
+    if (iFirst != iBlockFirst)
+        SweepBlock(reader, iFirst);
+    return mask + ((size_t) k * nBlockRows + (iRow - iFirst)) * nRowBytes;
+}
+
+inline void ShadowSweep::GetInputRows(int iFirstRow, int iLastRow,
+                                      int *piReadFirst, int *piReadLast) const
+{
+    const int iFirst = iFirstRow - iFirstRow % nBlockRows;
+    int       iLast = (iLastRow / nBlockRows + 1) * nBlockRows - 1;
+    if (iLast > nYSize - 1)
+        iLast = nYSize - 1;
+
+    // As SweepBlock starts out
+    *piReadFirst = (rowStep < 0) ? iFirst - nReach : iFirst;
+    *piReadLast  = (rowStep < 0) ? iLast : iLast + nReach;
+    if (*piReadFirst < 0)
+        *piReadFirst = 0;
+    if (*piReadLast > nYSize - 1)
+        *piReadLast = nYSize - 1;
+}
+
+inline void ShadowSweep::SweepBlock(BandRowReader &reader, int iFirst)
+{
+    const int iLast = (iFirst + nBlockRows < nYSize) ? iFirst + nBlockRows - 1 : nYSize - 1;
+    // The predecessor row (rowStep) must already be swept
+    const int iStart = (rowStep < 0) ? iFirst - nReach : iLast + nReach;
+    const int iFrom = (iStart < 0) ? 0 : (iStart >= nYSize ? nYSize - 1 : iStart);
+    const int iTo = (rowStep < 0) ? iLast : iFirst;
+    std::vector<int>   hasNoData(nBands);
+    std::vector<float> noData(nBands);
+
+    for (int k = 0; k < nBands; k++)
+        noData[k] = (float) reader.GetBand(k)->GetNoDataValue( &hasNoData[k] );
+    memset(mask, 0, (size_t) nBands * nBlockRows * nRowBytes);
+    for (size_t j = 0; j < (size_t) nXSize * nBands; j++)
+        prev[j] = NO_HEIGHT;
+
+    for (int i = iFrom; i != iTo - rowStep; i -= rowStep) {
+      for (int k = 0; k < nBands; k++) {
+        const float *row = reader.GetRow(k, i);
+        double      *bandCur  = cur + (size_t) k * nXSize;
+        double      *bandPrev = prev + (size_t) k * nXSize;
+        GByte *maskRow = (i >= iFirst && i <= iLast) ?
+            mask + ((size_t) k * nBlockRows + (i - iFirst)) * nRowBytes : NULL;
+
+        for (int m = 0; m < nXSize; m++) {
+            const int j = (colStep < 0) ? m : nXSize - 1 - m;
+            const int jp = j + colStep;
+            double pred;
+
+            if (rowMajor) {
+                pred = (jp < 0 || jp >= nXSize) ? bandPrev[j]
+                       : LerpHeight(bandPrev[j], bandPrev[jp], shift);
+            } else {
+                pred = (jp < 0 || jp >= nXSize) ? NO_HEIGHT
+                       : LerpHeight(bandCur[jp], bandPrev[jp], shift);
+            }
+
+            const double horizon = (pred <= NO_HEIGHT) ? NO_HEIGHT : pred - drop;
+            const float  v = row[j];
+            double       height = NO_HEIGHT;
+
+            if (v == v && !(hasNoData[k] && v == noData[k])) {
+                height = v * z;
+                if (height < horizon && maskRow != NULL)
+                    maskRow[j >> 3] |= 1 << (j & 7);
+            }
+            bandCur[j] = (height > horizon) ? height : horizon;
+        }
+      }
+
+        double *tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+    iBlockFirst = iFirst;
+}
+
+#endif /* SHADOWS_H */
@@ -31,25 +31,26 @@
 #include <stdlib.h>
 #include <math.h>
 #include "gdal_priv.h"
+#include "rowwindow.h"
+#include "membudget.h"
+#include "demoutput.h"
+#include "checkpoint.h"
+#include "demstats.h"
+#include "gradient.h"
 
 int main(int nArgc, char ** papszArgv) 
 { 
     GDALDataset *poDataset;     
-    const float degrees_to_radians = 3.14159 / 180.0;
     const float radians_to_degrees = 180.0 / 3.14159;           
     double      adfGeoTransform[6];
     float       *win;
-    float       *aspectBuf;
     float       *slopeBuf;
     float       dx;
     float       dy;
     float       key;
     float       slopePct;
-    float       aspect;
     int         i;
     int         j;
-    int         n;
-    int         containsNull;
 
     /* -----------------------------------
      * Defaults
@@ -58,7 +59,18 @@ int main(int nArgc, char ** papszArgv)
     int slopeFormat = 1; 
     // vertical units per horizontal unit (for slope calc)
     float scale = 1.0; 
-    char *pszFormat = "GTiff";
+    const char *pszFormat = "GTiff";
+    char      **papszOptions = NULL;
+    int         resume = 0;
+    Checkpoint  checkpoint;
+    int         yOff = 0;
+    int         nOutRows = -1;
+    const char *pszStatsFilename = NULL;
+    const char *pszClasses = NULL;
+    DemStats    stats;
+    char      **papszBands = NULL;
+    std::vector<int> bands;
+    MemBudget budget;
 
     /* -----------------------------------
      * Parse Input Arguments
@@ -68,10 +80,28 @@ int main(int nArgc, char ** papszArgv)
         printf( " \n Generates a slope map from any GDAL-supported elevation raster\n"
                 " Usage: \n"
                 "   slope input_dem output_slope_map \n"
-                "                 [-p use percent slope (default=degrees)] [-s scale* (default=1)]\n\n"
+                "                 [-p use percent slope (default=degrees)] [-s scale* (default=1)]\n"
+                "                 [-of output format: GTiff or RAW] [-co NAME=VALUE]*\n"
+                "                 [-mem memory budget in MB] [-resume [-ci seconds]]\n"
+                "                 [-rows first count] [-stats report.json|csv [-classes edges]]\n"
+                "                 [-b band]* [-b all]\n"
+                "   slope gradient_raster output_slope_map [options]\n\n"
                 " Notes : \n"
                 "   Scale is the ratio of vertical units to horizontal\n"
-                "     for Feet:Latlong try scale=370400, for Meters:LatLong try scale=111120 \n\n");
+                "     for Feet:Latlong try scale=370400, for Meters:LatLong try scale=111120 \n"
+                "   -co passes creation options to the driver, e.g. -co COMPRESS=DEFLATE\n"
+                "   -resume checkpoints every 300 seconds (-ci seconds) and, rerun with the\n"
+                "     same arguments, carries on from the last checkpoint\n"
+                "   -rows computes just that strip of the output, reading the rows\n"
+                "     around it from the input (used by demshard)\n"
+                "   -stats writes min/max/mean/stddev and a histogram of slope classes\n"
+                "     (default 0,2,5,10,15,30,45 degrees or 0,5,10,20,30,50,100 percent)\n"
+                "     to a report and the output's statistics, in the same pass\n"
+                "   -b picks the input bands to process (default 1) in one pass, giving\n"
+                "     an output band and a section of the report for each\n"
+                "   A gradient raster saved by hillshade -savegrad is read instead of a DEM\n"
+                "     without any window: -s still applies, the smoothing is hillshade's\n"
+                "   An output of - streams raw Float32 rows to stdout\n\n");
         exit(1);
     }
 
@@ -85,52 +115,120 @@ int main(int nArgc, char ** papszArgv)
         if( EQUAL(papszArgv[iArg],"-s") ||
             EQUAL(papszArgv[iArg],"-scale"))
             scale = atof(papszArgv[iArg+1]);
-        // TO DO : Add Output Format
+        if( EQUAL(papszArgv[iArg],"-mem") )
+            budget.Set(papszArgv[iArg+1]);
+        if( EQUAL(papszArgv[iArg],"-of") )
+            pszFormat = papszArgv[iArg+1];
+        if( EQUAL(papszArgv[iArg],"-co") )
+            papszOptions = AddCreationOption(papszOptions, papszArgv[iArg+1]);
+        if( EQUAL(papszArgv[iArg],"-resume") )
+            resume = 1;
+        if( EQUAL(papszArgv[iArg],"-ci") )
+            checkpoint.SetInterval(atoi(papszArgv[iArg+1]));
+        if( EQUAL(papszArgv[iArg],"-rows") )
+        {
+            yOff = atoi(papszArgv[iArg+1]);
+            nOutRows = atoi(papszArgv[iArg+2]);
+        }
+        if( EQUAL(papszArgv[iArg],"-stats") )
+            pszStatsFilename = papszArgv[iArg+1];
+        if( EQUAL(papszArgv[iArg],"-classes") )
+            pszClasses = papszArgv[iArg+1];
+        if( EQUAL(papszArgv[iArg],"-b") )
+            papszBands = CSLAddString(papszBands, papszArgv[iArg+1]);
     }
+    if (pszClasses == NULL)
+        pszClasses = slopeFormat ? "0,2,5,10,15,30,45" : "0,5,10,20,30,50,100";
+    stats.SetClasses(pszClasses);
 
 
+    papszOptions = ApplyCreationDefaults(papszOptions, pszFormat);
     GDALAllRegister(); 
 
     /*---------------------------------------
-     * Open Dataset and get raster band (assuming it is band #1)
+     * Open Dataset and get the raster bands (band #1 unless -b says otherwise)
      */
     poDataset = (GDALDataset *) GDALOpen( pszFilename, GA_ReadOnly );
     if( poDataset == NULL )
     {
-        printf( "Couldn't open dataset %s\n", 
-                pszFilename );
+        fprintf( stderr, "Couldn't open dataset %s\n", 
+                 pszFilename );
+        exit(1);
     }
+    // A gradient raster saved by hillshade -savegrad stands in for the DEM
+    float       gradScale;
+    const bool  isGradient = IsGradientRaster(poDataset, &gradScale);
+    if (isGradient ? !SelectGradientBands(poDataset, papszBands, bands)
+                   : !SelectBands(poDataset->GetRasterCount(), papszBands, bands))
+        exit(1);
+    const std::vector<int> readBands = isGradient ? GetGradientBands(poDataset, bands) : bands;
     GDALRasterBand  *poBand;       
-    poBand = poDataset->GetRasterBand( 1 );
+    poBand = poDataset->GetRasterBand( readBands[0] );
     poDataset->GetGeoTransform( adfGeoTransform );
+    const int   nBands = (int) bands.size();
+    const int   nReadBands = isGradient ? 2 * nBands : nBands;
 
     // Variables related to input dataset
     const double cellsizeY = adfGeoTransform[5];
     const double cellsizeX = adfGeoTransform[1];
-    const float nullValue = (float) poBand->GetNoDataValue( );
+    const float slopeNullValue = -9999.;
     const int   nXSize = poBand->GetXSize();
     const int   nYSize = poBand->GetYSize();
+    if (nOutRows < 0)
+        nOutRows = nYSize - yOff;
+    if (yOff < 0 || nOutRows < 1 || yOff + nOutRows > nYSize)
+    {
+        fprintf( stderr, "Rows %d to %d are outside the input\n",
+                 yOff, yOff + nOutRows - 1 );
+        exit(1);
+    }
     slopeBuf    = (float *) CPLMalloc(sizeof(float)*nXSize); 
     win         = (float *) CPLMalloc(sizeof(float)*9);
+    const int   nChunkRows = budget.PickChunkRows(poBand, nReadBands);
+    const int   nQueueRows = budget.PickQueueRows(sizeof(double)*nXSize, OUTPUT_QUEUE_ROWS);
+    budget.Reserve(BandRowReader::GetMemorySize(nXSize, nReadBands, nChunkRows) +
+                   (isGradient ? 0 : nBands * RowWindow::GetMemorySize(nXSize, 1)) +
+                   AsyncOutputSink::GetMemorySize(nXSize, nQueueRows) +
+                   sizeof(float)*nXSize);
+    if (!budget.ApplyCacheMax())
+        exit(1);
+
+    // A window per band, all reading through one reader (a gradient
+    // raster's x and y bands are read through it too, without windows)
+    BandRowReader reader(poDataset, readBands, nChunkRows);
+    std::vector<RowWindow *> windows;
+    std::vector<DemStats>    bandStats(nBands, stats);
+    for (int b = 0; b < nBands && !isGradient; b++)
+        windows.push_back(new RowWindow(&reader, b, 1));
 
     /* -----------------------------------------
      * Open up the output datasets and copy over relevant metadata
      */
-    GDALDriver *poDriver;
-    poDriver = GetGDALDriverManager()->GetDriverByName(pszFormat);
-    GDALDataset      *poSlopeDS;    
-    GDALRasterBand   *poSlopeBand; 
-    char **papszOptions = NULL;
+    OutputSink       *poSlopeOut;
 
     /*
      * Open slope output map
      */
-    poSlopeDS = poDriver->Create(pszSlopeFilename,nXSize,nYSize,1,GDT_Float32, 
-                                papszOptions );
-    poSlopeDS->SetGeoTransform( adfGeoTransform );    
-    poSlopeDS->SetProjection( poDataset->GetProjectionRef() );
-    poSlopeBand = poSlopeDS->GetRasterBand(1);
-    poSlopeBand->SetNoDataValue(-9999);   
+    if (resume)
+        checkpoint.Enable(pszSlopeFilename, pszFormat, pszFilename, nArgc, papszArgv);
+    if (pszStatsFilename != NULL)
+        checkpoint.SetStats(&bandStats);
+    int         iStartRow;
+    poSlopeOut = checkpoint.Resume(nXSize, nOutRows, nQueueRows, &iStartRow);
+    if (poSlopeOut == NULL)
+        poSlopeOut = CreateOutputSink(pszSlopeFilename, pszFormat, nXSize, nOutRows, nBands,
+                                      GDT_Float32, papszOptions, nQueueRows );
+    if (poSlopeOut == NULL)
+    {
+        fprintf( stderr, "Couldn't create output %s\n", pszSlopeFilename );
+        exit(1);
+    }
+    OffsetGeoTransform( adfGeoTransform, 0, yOff );
+    poSlopeOut->SetGeoTransform( adfGeoTransform );    
+    poSlopeOut->SetProjection( poDataset->GetProjectionRef() );
+    poSlopeOut->SetNoDataValue(slopeNullValue);   
+    if (isGradient)
+        CheckGradientWindow( poDataset, poSlopeOut );
 
 
     /* ------------------------------------------
@@ -142,52 +240,55 @@ int main(int nArgc, char ** papszArgv)
      *                 6 7 8
      *  and calculate slope and aspect
      */
-    for ( i = 0; i < nYSize; i++) 
+    for ( i = yOff + iStartRow; i < yOff + nOutRows; i++) 
     {
-        for ( j = 0; j < nXSize; j++) 
-        {
-            containsNull = 0;
-
-            // Exclude the edges 
-            if (i == 0 || j == 0 || i == nYSize-1 || j == nXSize-1 ) 
-            {
-                // We are at the edge so write nullValues and move on
-                slopeBuf[j] = nullValue;
-                continue;
-            }
+      for ( int b = 0; b < nBands; b++ )
+      {
+        RowWindow  *poWindow = isGradient ? NULL : windows[b];
+        const float *gradX = NULL;
+        const float *gradY = NULL;
 
-            // Read in 3x3 window
-            poBand->RasterIO( GF_Read, j-1, i-1, 3, 3,
-                          win, 3, 3, GDT_Float32, 
-                          0, 0 ); 
-
-            // Check if window has null value
-            for ( n = 0; n <= 8; n++) 
-            {
-               if(win[n] == nullValue) 
-               {
-                   containsNull = 1;
-                   break;
-               }
-            }
+        if (isGradient)
+        {
+            gradX = reader.GetRow(2 * b, i);
+            gradY = reader.GetRow(2 * b + 1, i);
+        }
+        else
+            poWindow->Advance(i);
 
-            if (containsNull == 1) 
+        for ( j = 0; j < nXSize; j++) 
+        {
+            // Skip the edges and windows containing nodata
+            if (isGradient ? (gradX[j] == GRADIENT_NODATA || gradY[j] == GRADIENT_NODATA)
+                           : !poWindow->IsValid(j)) 
             {
-                // We have nulls so write nullValues and move on
-                 slopeBuf[j] = nullValue;
+                // Write nullValues and move on
+                slopeBuf[j] = slopeNullValue;
                 continue;
             } 
             else 
             {
-                // We have a valid 3x3 window to compute slope
-                dx = ((win[0] + win[3] + win[3] + win[6]) - 
-                      (win[2] + win[5] + win[5] + win[8]));
+                if (isGradient)
+                {
+                    // Each cell from its saved gradient alone
+                    dx = DecodeGradient(gradX[j]) * gradScale / scale;
+                    dy = DecodeGradient(gradY[j]) * gradScale / scale;
+                    key = dx*dx + dy*dy;
+                }
+                else
+                {
+                    poWindow->GetWindow(j, win);
+
+                    // We have a valid 3x3 window to compute slope
+                    dx = ((win[0] + win[3] + win[3] + win[6]) - 
+                          (win[2] + win[5] + win[5] + win[8]));
 
-                dy = ((win[6] + win[7] + win[7] + win[8]) - 
-                      (win[0] + win[1] + win[1] + win[2]));
+                    dy = ((win[6] + win[7] + win[7] + win[8]) - 
+                          (win[0] + win[1] + win[1] + win[2]));
 
-                key = ((dx/(8*cellsizeX*scale)) * (dx/(8*cellsizeX*scale))) + 
-                      ((dy/(8*cellsizeY*scale)) * (dy/(8*cellsizeY*scale)));
+                    key = ((dx/(8*cellsizeX*scale)) * (dx/(8*cellsizeX*scale))) + 
+                          ((dy/(8*cellsizeY*scale)) * (dy/(8*cellsizeY*scale)));
+                }
 
                 slopePct = 100*sqrt(key);
                 if (slopeFormat == 1) 
@@ -195,6 +296,9 @@ int main(int nArgc, char ** papszArgv)
                 else
                     slopeBuf[j] = slopePct;
 
+                if (pszStatsFilename != NULL)
+                    bandStats[b].Add(slopeBuf[j]);
+
             }
         }
 
@@ -202,11 +306,40 @@ int main(int nArgc, char ** papszArgv)
          * Write Line to File
          */
 
-         poSlopeBand->RasterIO( GF_Write, 0, i, nXSize, 1, 
-                      slopeBuf, nXSize, 1, GDT_Float32, 0, 0 ); 
+         if (!poSlopeOut->WriteRow( b + 1, i - yOff, slopeBuf, GDT_Float32 ))
+         {
+             fprintf( stderr, "Couldn't write %s\n", pszSlopeFilename );
+             exit(1);
+         }
+         bandStats[b].AddRows(1);
+      }
+      checkpoint.RowDone( poSlopeOut, i - yOff + 1 );
     }
 
-    delete poSlopeDS;
+    if (pszStatsFilename != NULL)
+    {
+        for (int b = 0; b < nBands; b++)
+        {
+            if (bandStats[b].GetCount() > 0)
+                poSlopeOut->SetStatistics( b + 1, bandStats[b].GetMin(), bandStats[b].GetMax(),
+                                   bandStats[b].GetMean(), bandStats[b].GetStdDev() );
+        }
+        if (!WriteStatsReport(pszStatsFilename, bandStats, bands))
+            fprintf( stderr, "Couldn't write %s\n", pszStatsFilename );
+    }
+
+    if (!poSlopeOut->Flush())
+    {
+        fprintf( stderr, "Couldn't write %s\n", pszSlopeFilename );
+        exit(1);
+    }
+    delete poSlopeOut;
+    for (size_t b = 0; b < windows.size(); b++)
+        delete windows[b];
+    CSLDestroy(papszBands);
+    CSLDestroy(papszOptions);
+    checkpoint.Finish();
+    ReportPeakRSS(budget);
 
     return 0;
 }
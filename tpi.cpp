@@ -0,0 +1,307 @@
+/****************************************************************************
+ * tpi.cpp
+ * Author: agent
+ * License : 
+ Copyright 2026 agent
+ Licensed under the Apache License, Version 2.0 (the "License"); 
+ you may not use this file except in compliance with the License. 
+ You may obtain a copy of the License at 
+ 
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software 
+ distributed under the License is distributed on an "AS IS" BASIS, 
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+ See the License for the specific language governing permissions and 
+ limitations under the License.
+
+ * calculates topographic position index, terrain ruggedness index or
+ * roughness for a gdal-supported raster DEM over a square neighbourhood
+ * of any radius
+ *
+ * TPI       : cell value minus the mean of its neighbours
+ * TRI       : root mean square difference between the cell and its
+ *             neighbours (Riley's TRI normalized by the neighbour count)
+ * roughness : standard deviation of the values in the neighbourhood
+ *
+ * Neighbourhoods are clipped at the raster edges and skip nodata cells.
+ *
+ * References:
+ * Weiss, A. (2001). "Topographic Position and Landforms Analysis", poster,
+ * ESRI User Conference.
+ * Riley, S.J., DeGloria, S.D. and Elliot, R. (1999). "A terrain ruggedness
+ * index that quantifies topographic heterogeneity", Intermountain Journal of
+ * Sciences 5:23-27.
+ ****************************************************************************/
+
+#include <iostream>
+#include <stdlib.h>
+#include <math.h>
+#include "gdal_priv.h"
+#include "rowwindow.h"
+#include "boxsums.h"
+#include "membudget.h"
+#include "demoutput.h"
+#include "checkpoint.h"
+
+#define MODE_TPI        0
+#define MODE_TRI        1
+#define MODE_ROUGHNESS  2
+
+int main(int nArgc, char ** papszArgv)
+{
+    GDALDataset *poDataset;
+    double      adfGeoTransform[6];
+    float       *outBuf;
+    double      sum;
+    double      sumSq;
+    int         count;
+    double      center;
+    double      mean;
+    double      variance;
+    int         i;
+    int         j;
+
+    /* -----------------------------------
+     * Defaults
+     */
+    int         mode = MODE_TPI;
+    int         radius = 1;
+    const char *pszFormat = "GTiff";
+    char      **papszOptions = NULL;
+    int         resume = 0;
+    Checkpoint  checkpoint;
+    int         yOff = 0;
+    int         nOutRows = -1;
+    char      **papszBands = NULL;
+    std::vector<int> bands;
+    MemBudget   budget;
+
+    /* -----------------------------------
+     * Parse Input Arguments
+     */
+    if (nArgc < 3)
+    {
+        printf( " \n Generates a topographic position index, terrain ruggedness index\n"
+                " or roughness map from any GDAL-supported elevation raster\n"
+                " Usage: \n"
+                "   tpi input_dem output_map \n"
+                "                 [-m tpi|tri|roughness (default=tpi)] [-r radius in cells (default=1)]\n"
+                "                 [-of output format: GTiff or RAW] [-co NAME=VALUE]*\n"
+                "                 [-mem memory budget in MB] [-resume [-ci seconds]]\n"
+                "                 [-rows first count] [-b band]* [-b all]\n\n"
+                " Notes : \n"
+                "   The cost per cell doesn't depend on the radius; memory grows with\n"
+                "   radius * raster width\n"
+                "   -co passes creation options to the driver, e.g. -co COMPRESS=DEFLATE\n"
+                "   -resume checkpoints every 300 seconds (-ci seconds) and, rerun with the\n"
+                "     same arguments, carries on from the last checkpoint\n"
+                "   -rows computes just that strip of the output, reading the rows\n"
+                "     around it from the input (used by demshard)\n"
+                "   -b picks the input bands to process (default 1) in one pass, giving\n"
+                "     an output band for each\n"
+                "   An output of - streams raw Float32 rows to stdout\n\n");
+        exit(1);
+    }
+
+    const char  *pszFilename = papszArgv[1];
+    const char  *pszOutFilename = papszArgv[2];
+
+    for ( int iArg = 3; iArg < nArgc; iArg++ )
+    {
+        if( EQUAL(papszArgv[iArg],"-m") ||
+            EQUAL(papszArgv[iArg],"-mode"))
+        {
+            if( EQUAL(papszArgv[iArg+1],"tri") )
+                mode = MODE_TRI;
+            else if( EQUAL(papszArgv[iArg+1],"roughness") )
+                mode = MODE_ROUGHNESS;
+            else
+                mode = MODE_TPI;
+        }
+        if( EQUAL(papszArgv[iArg],"-r") ||
+            EQUAL(papszArgv[iArg],"-radius"))
+            radius = atoi(papszArgv[iArg+1]);
+        if( EQUAL(papszArgv[iArg],"-of") )
+            pszFormat = papszArgv[iArg+1];
+        if( EQUAL(papszArgv[iArg],"-co") )
+            papszOptions = AddCreationOption(papszOptions, papszArgv[iArg+1]);
+        if( EQUAL(papszArgv[iArg],"-resume") )
+            resume = 1;
+        if( EQUAL(papszArgv[iArg],"-ci") )
+            checkpoint.SetInterval(atoi(papszArgv[iArg+1]));
+        if( EQUAL(papszArgv[iArg],"-rows") )
+        {
+            yOff = atoi(papszArgv[iArg+1]);
+            nOutRows = atoi(papszArgv[iArg+2]);
+        }
+        if( EQUAL(papszArgv[iArg],"-mem") )
+            budget.Set(papszArgv[iArg+1]);
+        if( EQUAL(papszArgv[iArg],"-b") )
+            papszBands = CSLAddString(papszBands, papszArgv[iArg+1]);
+    }
+
+    if (radius < 1)
+    {
+        fprintf( stderr, "Radius must be at least 1\n" );
+        exit(1);
+    }
+
+    papszOptions = ApplyCreationDefaults(papszOptions, pszFormat);
+    GDALAllRegister();
+
+    /*---------------------------------------
+     * Open Dataset and get the raster bands (band #1 unless -b says otherwise)
+     */
+    poDataset = (GDALDataset *) GDALOpen( pszFilename, GA_ReadOnly );
+    if( poDataset == NULL )
+    {
+        fprintf( stderr, "Couldn't open dataset %s\n",
+                 pszFilename );
+        exit(1);
+    }
+    if (!SelectBands(poDataset->GetRasterCount(), papszBands, bands))
+        exit(1);
+    GDALRasterBand  *poBand;
+    poBand = poDataset->GetRasterBand( bands[0] );
+    poDataset->GetGeoTransform( adfGeoTransform );
+    const int   nBands = (int) bands.size();
+
+    // Variables related to input dataset
+    const float nullValue = -9999;
+    const int   nXSize = poBand->GetXSize();
+    const int   nYSize = poBand->GetYSize();
+    if (nOutRows < 0)
+        nOutRows = nYSize - yOff;
+    if (yOff < 0 || nOutRows < 1 || yOff + nOutRows > nYSize)
+    {
+        fprintf( stderr, "Rows %d to %d are outside the input\n",
+                 yOff, yOff + nOutRows - 1 );
+        exit(1);
+    }
+
+    const int   nChunkRows = budget.PickChunkRows(poBand, nBands);
+    const int   nQueueRows = budget.PickQueueRows(sizeof(double)*nXSize, OUTPUT_QUEUE_ROWS);
+    budget.Reserve(BandRowReader::GetMemorySize(nXSize, nBands, nChunkRows) +
+                   nBands * (RowWindow::GetMemorySize(nXSize, radius) +
+                             BoxSums::GetMemorySize(nXSize)) +
+                   AsyncOutputSink::GetMemorySize(nXSize, nQueueRows) +
+                   sizeof(float)*nXSize);
+    if (!budget.ApplyCacheMax())
+        exit(1);
+
+    // A window and box per band, all reading through one reader
+    BandRowReader reader(poDataset, bands, nChunkRows);
+    std::vector<RowWindow *> windows;
+    std::vector<BoxSums *>   boxes;
+    for (int b = 0; b < nBands; b++)
+    {
+        // Sums are taken relative to the approximate mean to keep the
+        // sums of squares well conditioned
+        double dfMin, dfMax, dfMean, dfStdDev;
+        if (reader.GetBand(b)->GetStatistics(TRUE, TRUE, &dfMin, &dfMax, &dfMean, &dfStdDev) != CE_None)
+            dfMean = 0;
+
+        windows.push_back(new RowWindow(&reader, b, radius));
+        boxes.push_back(new BoxSums(windows[b], nXSize, radius, dfMean));
+    }
+    outBuf      = (float *) CPLMalloc(sizeof(float)*nXSize);
+
+    /* -----------------------------------------
+     * Open up the output dataset and copy over relevant metadata
+     */
+    OutputSink       *poOut;
+
+    if (resume)
+        checkpoint.Enable(pszOutFilename, pszFormat, pszFilename, nArgc, papszArgv);
+    int         iStartRow;
+    poOut = checkpoint.Resume(nXSize, nOutRows, nQueueRows, &iStartRow);
+    if (poOut == NULL)
+        poOut = CreateOutputSink(pszOutFilename, pszFormat, nXSize, nOutRows, nBands,
+                                 GDT_Float32, papszOptions, nQueueRows );
+    if (poOut == NULL)
+    {
+        fprintf( stderr, "Couldn't create output %s\n", pszOutFilename );
+        exit(1);
+    }
+    OffsetGeoTransform( adfGeoTransform, 0, yOff );
+    poOut->SetGeoTransform( adfGeoTransform );
+    poOut->SetProjection( poDataset->GetProjectionRef() );
+    poOut->SetNoDataValue(nullValue);
+
+    /* ------------------------------------------
+     * Move the (2r+1)x(2r+1) box over each cell
+     */
+    for ( i = yOff + iStartRow; i < yOff + nOutRows; i++)
+    {
+      for ( int b = 0; b < nBands; b++ )
+      {
+        BoxSums       &box  = *boxes[b];
+        box.Advance(i);
+        const float   *row  = windows[b]->GetRow(0);
+        const GUInt32 *mask = windows[b]->GetMask(0);
+
+        for ( j = 0; j < nXSize; j++)
+        {
+            box.GetBox(j, &sum, &sumSq, &count);
+
+            // Nodata cells and cells without neighbours get nullValue
+            if (((mask[j >> 5] >> (j & 31)) & 1) || count < 2)
+            {
+                outBuf[j] = nullValue;
+                continue;
+            }
+
+            center = row[j] - box.GetOffset();
+
+            if (mode == MODE_TPI)
+            {
+                // Mean of the neighbours, without the cell itself
+                mean = (sum - center) / (count - 1);
+                outBuf[j] = center - mean;
+            }
+            else if (mode == MODE_TRI)
+            {
+                // sum((z - c)^2) = sumSq - 2 c sum + n c^2
+                variance = (sumSq - 2 * center * sum + count * center * center) / (count - 1);
+                outBuf[j] = (variance > 0) ? sqrt(variance) : 0;
+            }
+            else
+            {
+                mean = sum / count;
+                variance = sumSq / count - mean * mean;
+                outBuf[j] = (variance > 0) ? sqrt(variance) : 0;
+            }
+        }
+
+        /* -----------------------------------------
+         * Write Line to File
+         */
+        if (!poOut->WriteRow( b + 1, i - yOff, outBuf, GDT_Float32 ))
+        {
+            fprintf( stderr, "Couldn't write %s\n", pszOutFilename );
+            exit(1);
+        }
+      }
+      checkpoint.RowDone( poOut, i - yOff + 1 );
+    }
+
+    CPLFree(outBuf);
+    if (!poOut->Flush())
+    {
+        fprintf( stderr, "Couldn't write %s\n", pszOutFilename );
+        exit(1);
+    }
+    delete poOut;
+    for (int b = 0; b < nBands; b++)
+    {
+        delete boxes[b];
+        delete windows[b];
+    }
+    CSLDestroy(papszBands);
+    CSLDestroy(papszOptions);
+    checkpoint.Finish();
+    ReportPeakRSS(budget);
+
+    return 0;
+}